@@ -0,0 +1,235 @@
+#pragma once
+
+// Non-interactive batch judging: judges every submission in a directory or
+// manifest and writes a JSON or CSV report.
+//
+// Compiles and the individual test runs of all submissions go through one
+// TaskScheduler (see scheduler.h), so cores stay busy while a submission
+// sits on a long test and small submissions are not stuck behind big ones.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "judge.h"
+#include "report.h"
+#include "scheduler.h"
+
+struct BatchOptions {
+    std::filesystem::path target;      // directory of .cpp files or a manifest
+    int defaultProblem = 0;            // for directories and manifest lines without an ID
+    std::filesystem::path reportPath;  // .json or .csv; empty = JSON on stdout
+    unsigned compileJobs = 0;          // concurrent compiles, 0 = half of the concurrent test runs
+    bool allTests = false;             // run every test instead of stopping at the first failure
+};
+
+// Reads a manifest: one submission per line, "<problemID> <path>" or just
+// "<path>". Blank lines and lines starting with '#' are ignored; relative
+// paths are relative to the manifest.
+inline std::vector<BatchItem> read_batch_manifest(const std::filesystem::path& manifest, int defaultProblem,
+                                                  std::string& error) {
+    std::vector<BatchItem> items;
+    std::ifstream file(manifest);
+    if (!file.is_open()) {
+        error = "cannot open manifest " + manifest.string();
+        return items;
+    }
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(file, line)) {
+        ++lineNo;
+        std::string trimmed = trim(line);
+        if (trimmed.empty() || trimmed[0] == '#') continue;
+
+        BatchItem item;
+        item.problemID = defaultProblem;
+        size_t space = trimmed.find_first_of(" \t");
+        std::string first = trimmed.substr(0, space);
+        if (space != std::string::npos && std::all_of(first.begin(), first.end(), ::isdigit)) {
+            item.problemID = std::stoi(first);
+            trimmed = trim(trimmed.substr(space));
+        }
+        if (item.problemID == 0) {
+            error = manifest.string() + ":" + std::to_string(lineNo) + ": no problem ID (use --problem)";
+            return {};
+        }
+        std::filesystem::path path(trimmed);
+        if (path.is_relative()) path = manifest.parent_path() / path;
+        item.path = path.string();
+        items.push_back(item);
+    }
+    return items;
+}
+
+inline std::vector<BatchItem> collect_batch_items(const BatchOptions& options, std::string& error) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(options.target, ec)) {
+        return read_batch_manifest(options.target, options.defaultProblem, error);
+    }
+    if (options.defaultProblem == 0) {
+        error = "judging a directory needs a problem ID (use --problem)";
+        return {};
+    }
+    std::vector<BatchItem> items;
+    for (const auto& entry : std::filesystem::directory_iterator(options.target, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".cpp") {
+            items.push_back({options.defaultProblem, entry.path().string()});
+        }
+    }
+    std::sort(items.begin(), items.end(), [](const BatchItem& a, const BatchItem& b) { return a.path < b.path; });
+    return items;
+}
+
+// Returns the process exit code: 0 if the batch ran (whatever the verdicts).
+inline int run_batch(const BatchOptions& batch, const JudgeOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    auto msSince = [](Clock::time_point since) {
+        return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count());
+    };
+
+    std::string error;
+    std::vector<BatchItem> items = collect_batch_items(batch, error);
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        return 2;
+    }
+    if (items.empty()) {
+        std::cerr << "Error: no submissions found in " << batch.target << "\n";
+        return 2;
+    }
+
+    // Load every problem once up front. One that cannot be loaded is a
+    // Judge Error for its submissions only.
+    std::map<int, std::shared_ptr<const LoadedProblem>> problems;
+    std::map<int, std::string> loadErrors;
+    for (const BatchItem& item : items) {
+        if (problems.count(item.problemID)) continue;
+        std::shared_ptr<const LoadedProblem> problem;
+        try {
+            problem = loadProblem(item.problemID, options);
+        } catch (const std::exception& e) {
+            loadErrors[item.problemID] = e.what();
+        }
+        problems[item.problemID] = problem && problem->testCount() > 0 ? problem : nullptr;
+    }
+
+    const unsigned runJobs = std::max(1u, options.jobs);
+    const unsigned compileJobs = batch.compileJobs ? batch.compileJobs : std::max(1u, runJobs / 2);
+    std::cerr << "Judging " << items.size() << " submission(s) with up to " << compileJobs << " compile(s) and "
+              << runJobs << " test run(s) at a time\n";
+
+    std::vector<SubmissionRecord> records(items.size());
+    for (size_t i = 0; i < items.size(); ++i) records[i].item = items[i];
+
+    // What a submission holds from its compile until its last test.
+    struct Judging {
+        std::optional<CompiledSubmission> build;
+        std::unique_ptr<ForkServer> server;
+        std::unique_ptr<TestPrefetcher> tests;
+        Clock::time_point started;
+    };
+    std::vector<Judging> judging(items.size());
+    std::atomic<size_t> finished{0};
+    std::mutex progressMutex;
+    const Clock::time_point batchStart = Clock::now();
+
+    auto progress = [&](const SubmissionRecord& r) {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        std::cerr << "[" << ++finished << "/" << items.size() << "] " << r.item.path << ": " << verdict_name(r.verdict);
+        if (r.total) std::cerr << " (" << r.passed << "/" << r.total << ")";
+        std::cerr << "\n";
+    };
+
+    TaskScheduler scheduler({compileJobs, runJobs});
+    for (size_t index = 0; index < items.size(); ++index) {
+        SubmissionRecord& record = records[index];
+        Judging& job = judging[index];
+        const LoadedProblem* problem = problems[record.item.problemID].get();
+        SubmissionTasks tasks;
+        tasks.stopOnFailure = !batch.allTests;
+        tasks.compile = [&, problem](std::vector<size_t>& order) -> size_t {
+            job.started = Clock::now();
+            if (auto failed = loadErrors.find(record.item.problemID); failed != loadErrors.end()) {
+                record.message = "cannot load problem " + std::to_string(record.item.problemID) + ": " +
+                                 failed->second;
+                progress(record);
+                return 0;
+            }
+            if (!problem) {
+                record.message = "no test cases for problem " + std::to_string(record.item.problemID);
+                progress(record);
+                return 0;
+            }
+            if (!std::filesystem::exists(record.item.path)) {
+                record.message = "source file not found";
+                progress(record);
+                return 0;
+            }
+            job.build = compileSubmission(record.item.path, options);
+            if (!recordCompile(record, *job.build)) {
+                job.build.reset();
+                record.judgeMs = msSince(job.started);
+                progress(record);
+                return 0;
+            }
+            record.total = problem->testCount();
+            job.server = startForkServer(*job.build, *problem);
+            order = testOrder(*problem, runJobs);
+            job.tests = std::make_unique<TestPrefetcher>(
+                record.total, testReadAhead, [problem](size_t i) { return problem->loadTest(i); }, order);
+            return record.total;
+        };
+        tasks.runTest = [&, problem](size_t i, const std::atomic<bool>& cancel) {
+            return runPrefetchedTest(job.build->exePath, *problem, *job.tests, i, &cancel, job.server.get());
+        };
+        tasks.report = [&, problem](size_t i, const TestOutcome& outcome) {
+            recordTest(record, *problem, i, outcome);
+        };
+        tasks.done = [&, problem](size_t failed) {
+            TraceSpan cleanup("cleanup");
+            job.server.reset();
+            job.tests.reset();
+            job.build.reset();   // releases the binary
+            if (problem->history) problem->history->save();
+            cleanup.end();
+            recordVerdict(record, failed);
+            record.judgeMs = msSince(job.started);
+            progress(record);
+        };
+        scheduler.submit(std::move(tasks));
+    }
+    scheduler.wait();
+
+    writeTrace(options);
+    double seconds = msSince(batchStart) / 1000.0;
+    std::cerr << "Judged " << items.size() << " submission(s) in " << seconds << " s ("
+              << (seconds > 0 ? items.size() * 60.0 / seconds : 0.0) << " submissions/min)\n";
+
+    if (batch.reportPath.empty()) {
+        write_batch_json(std::cout, records, seconds);
+        return 0;
+    }
+    std::ofstream report(batch.reportPath);
+    if (!report.is_open()) {
+        std::cerr << "Error: cannot write report to " << batch.reportPath << "\n";
+        return 1;
+    }
+    if (batch.reportPath.extension() == ".csv") {
+        write_batch_csv(report, records);
+    } else {
+        write_batch_json(report, records, seconds);
+    }
+    std::cerr << "Report written to " << batch.reportPath << "\n";
+    return 0;
+}
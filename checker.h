@@ -0,0 +1,330 @@
+#pragma once
+
+// Custom checkers ("special judges") for problems with more than one
+// correct answer. A checker gets the test input, the expected answer and
+// the submission's output and decides the verdict. Two kinds are
+// supported:
+//
+//   testlib     run once per test as `checker <input> <output> <answer>`;
+//               exit code 0 = accepted, 1/2/4/8 = wrong answer, anything
+//               else = checker failure. Works with testlib.h checkers.
+//   persistent  started on first use and kept running while the problem
+//               is loaded, one per test checked at a time. For every
+//               test the judge writes
+//                   "TEST <input bytes> <answer bytes> <output bytes>\n"
+//               followed by the three blobs, and the checker answers with
+//               one line "OK|WA|PE|FAIL [message]". judge_checker.h
+//               implements the checker side.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "process_runner.h"
+#include "test_executor.h"
+
+struct CheckResult {
+    Verdict verdict = Verdict::JudgeError;
+    std::string message;
+};
+
+// How long a checker may take for one test before it counts as failed.
+inline constexpr int checkerTimeoutMs = 30000;
+// Address space of a checker process.
+inline constexpr long long checkerMemoryBytes = 1LL << 30;
+
+namespace checker_detail {
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds left until `deadline`, for poll().
+inline int remaining_ms(Clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+
+inline std::string first_line(std::string_view text, size_t limit = 1024) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return {};
+    text.remove_prefix(start);
+    text = text.substr(0, std::min(text.find('\n'), limit));
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) text.remove_suffix(1);
+    return std::string(text);
+}
+
+} // namespace checker_detail
+
+// One long-running checker process speaking the persistent protocol.
+class CheckerProcess {
+public:
+    explicit CheckerProcess(std::string exePath) : exePath_(std::move(exePath)) {}
+
+    CheckerProcess(const CheckerProcess&) = delete;
+    CheckerProcess& operator=(const CheckerProcess&) = delete;
+
+    ~CheckerProcess() { stop(); }
+
+    // Checks one output, restarting the checker once if it has died.
+    CheckResult check(std::string_view input, std::string_view answer, std::string_view output) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (pid_ < 0 && !start()) return {Verdict::JudgeError, "cannot start checker: " + error_};
+            CheckResult result;
+            if (exchange(input, answer, output, result)) return result;
+            stop();
+        }
+        return {Verdict::JudgeError, "checker failed: " + error_};
+    }
+
+private:
+    bool start() {
+        int toChecker[2] = {-1, -1}, fromChecker[2] = {-1, -1};
+        if (!process_detail::make_pipe(toChecker) || !process_detail::make_pipe(fromChecker)) {
+            error_ = std::string("pipe: ") + std::strerror(errno);
+            for (int* p : {toChecker, fromChecker}) {
+                process_detail::close_fd(p[0]);
+                process_detail::close_fd(p[1]);
+            }
+            return false;
+        }
+        SpawnOptions spawn;
+        spawn.argv = {exePath_};
+        spawn.stdinFd = toChecker[0];
+        spawn.stdoutFd = fromChecker[1];
+        // The CPU limit covers the checker's whole life; one that runs out
+        // of it is restarted by check() like a crashed one.
+        spawn.limits.cpuTimeMs = checkerTimeoutMs;
+        spawn.limits.memoryBytes = checkerMemoryBytes;
+        SpawnedProcess child = spawn_process(spawn);
+        process_detail::close_fd(toChecker[0]);
+        process_detail::close_fd(fromChecker[1]);
+        if (child.pid < 0) {
+            error_ = child.error;
+            process_detail::close_fd(toChecker[1]);
+            process_detail::close_fd(fromChecker[0]);
+            return false;
+        }
+        pid_ = child.pid;
+        // Non-blocking, so a checker that stops reading cannot hold up a
+        // write past the deadline.
+        fcntl(toChecker[1], F_SETFL, fcntl(toChecker[1], F_GETFL) | O_NONBLOCK);
+        in_ = toChecker[1];
+        out_ = fromChecker[0];
+        buffer_.clear();
+        return true;
+    }
+
+    void stop() {
+        if (pid_ < 0) return;
+        process_detail::close_fd(in_);
+        process_detail::close_fd(out_);
+        kill(-pid_, SIGKILL);
+        while (waitpid(pid_, nullptr, 0) < 0 && errno == EINTR) {}
+        pid_ = -1;
+    }
+
+    bool exchange(std::string_view input, std::string_view answer, std::string_view output, CheckResult& result) {
+        std::string header = "TEST " + std::to_string(input.size()) + " " + std::to_string(answer.size()) + " " +
+                             std::to_string(output.size()) + "\n";
+        const auto deadline = checker_detail::Clock::now() + std::chrono::milliseconds(checkerTimeoutMs);
+        if (!send(header, deadline) || !send(input, deadline) || !send(answer, deadline) ||
+            !send(output, deadline)) {
+            return false;
+        }
+
+        size_t newline;
+        while ((newline = buffer_.find('\n')) == std::string::npos) {
+            pollfd fd{out_, POLLIN, 0};
+            int left = checker_detail::remaining_ms(deadline);
+            int ready = left > 0 ? poll(&fd, 1, left) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) {
+                error_ = timeoutError();
+                return false;
+            }
+            char chunk[4096];
+            ssize_t n = read(out_, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                error_ = "checker exited";
+                return false;
+            }
+            buffer_.append(chunk, static_cast<size_t>(n));
+        }
+        std::string line = buffer_.substr(0, newline);
+        buffer_.erase(0, newline + 1);
+
+        std::string_view status(line);
+        std::string_view message;
+        if (size_t space = status.find(' '); space != std::string_view::npos) {
+            message = status.substr(space + 1);
+            status = status.substr(0, space);
+        }
+        result.message = checker_detail::first_line(message);
+        if (status == "OK") {
+            result.verdict = Verdict::Accepted;
+        } else if (status == "WA" || status == "PE") {
+            result.verdict = Verdict::WrongAnswer;
+        } else if (status == "FAIL") {
+            result.verdict = Verdict::JudgeError;
+            result.message = "checker failed: " + result.message;
+        } else {
+            error_ = "unexpected answer '" + checker_detail::first_line(line, 64) + "'";
+            return false;
+        }
+        return true;
+    }
+
+    // Writes `data` to the checker's stdin before `deadline`.
+    bool send(std::string_view data, checker_detail::Clock::time_point deadline) {
+        while (!data.empty()) {
+            ssize_t n = write(in_, data.data(), data.size());
+            if (n > 0) {
+                data.remove_prefix(static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 || errno != EAGAIN) {
+                error_ = "checker stopped reading";
+                return false;
+            }
+            pollfd fd{in_, POLLOUT, 0};
+            int left = checker_detail::remaining_ms(deadline);
+            int ready = left > 0 ? poll(&fd, 1, left) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) {
+                error_ = timeoutError();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string timeoutError() {
+        return "no answer within " + std::to_string(checkerTimeoutMs / 1000) + " s";
+    }
+
+    std::string exePath_;
+    pid_t pid_ = -1;
+    int in_ = -1;
+    int out_ = -1;
+    std::string buffer_;   // checker output not consumed yet
+    std::string error_;
+};
+
+// The persistent checkers of one problem. A test takes an idle checker, or
+// starts one, and hands it back afterwards, so the processes outlive the
+// threads that judge a submission and are shared by all of them.
+class CheckerPool {
+public:
+    explicit CheckerPool(std::string exePath) : exePath_(std::move(exePath)) {}
+
+    CheckResult check(std::string_view input, std::string_view answer, std::string_view output) {
+        std::unique_ptr<CheckerProcess> checker;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!idle_.empty()) {
+                checker = std::move(idle_.back());
+                idle_.pop_back();
+            }
+        }
+        if (!checker) checker = std::make_unique<CheckerProcess>(exePath_);
+        CheckResult result = checker->check(input, answer, output);
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(checker));
+        return result;
+    }
+
+private:
+    std::string exePath_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<CheckerProcess>> idle_;
+};
+
+// Test data as files for programs that take file names (testlib checkers
+// and interactors). Raw tests use their own files; data held in memory is
+// written to a private temporary directory, removed again on destruction.
+class TestFiles {
+public:
+    TestFiles() = default;
+    TestFiles(const TestFiles&) = delete;
+    TestFiles& operator=(const TestFiles&) = delete;
+
+    ~TestFiles() {
+        std::error_code ec;
+        if (!dir_.empty()) std::filesystem::remove_all(dir_, ec);
+    }
+
+    // Returns `path` if it is set, and otherwise writes `data` to `name`.
+    std::string file(const char* name, std::string_view data, std::string_view path) {
+        if (!path.empty()) return std::string(path);
+        if (dir_.empty()) {
+            std::string dirTemplate = (std::filesystem::temp_directory_path() / "cpp-judge-check-XXXXXX").string();
+            if (!mkdtemp(dirTemplate.data())) {
+                error_ = std::string("mkdtemp: ") + std::strerror(errno);
+                return {};
+            }
+            dir_ = dirTemplate;
+        }
+        std::filesystem::path target = dir_ / name;
+        std::ofstream out(target, std::ios::binary);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) error_ = "cannot write " + target.string();
+        return target.string();
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    std::filesystem::path dir_;
+    std::string error_;
+};
+
+// Verdict of a program following testlib's exit code convention.
+inline CheckResult testlib_result(const RunResult& run, const char* who) {
+    CheckResult result;
+    if (!run.started) {
+        result.message = std::string("cannot start ") + who + ": " + run.error;
+        return result;
+    }
+    result.message = checker_detail::first_line(run.err.empty() ? run.out : run.err);
+    if (run.termSignal == 0) {
+        switch (run.exitCode) {
+            case 0: result.verdict = Verdict::Accepted; return result;
+            case 1: case 2: case 4: case 8: result.verdict = Verdict::WrongAnswer; return result;
+            default: break;
+        }
+    }
+    result.message = std::string(who) + " failed: " + result.message;
+    return result;
+}
+
+// Runs a testlib-style checker once.
+inline CheckResult run_testlib_checker(const std::string& exePath, std::string_view input,
+                                       std::string_view inputPath, std::string_view answer,
+                                       std::string_view answerPath, std::string_view output) {
+    TestFiles files;
+    std::string inputFile = files.file("input.txt", input, inputPath);
+    std::string answerFile = files.file("answer.txt", answer, answerPath);
+    std::string outputFile = files.file("output.txt", output, {});
+    if (!files.error().empty()) return {Verdict::JudgeError, files.error()};
+
+    RunOptions run;
+    run.argv = {exePath, inputFile, outputFile, answerFile};
+    run.limits.cpuTimeMs = checkerTimeoutMs;
+    run.limits.wallTimeMs = checkerTimeoutMs;
+    run.limits.memoryBytes = checkerMemoryBytes;
+    run.keepOutputBytes = 64 * 1024;
+    return testlib_result(run_process(run), "checker");
+}
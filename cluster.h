@@ -0,0 +1,1250 @@
+#pragma once
+
+// Distributed judging. A judge server started with --cluster-listen is the
+// coordinator: it still compiles every submission, but hands the tests to
+// worker nodes (`judge --worker HOST:PORT`) connected to it over TCP.
+//
+// Each worker slot (one per --jobs on the worker) receives a range of tests
+// of one submission and runs it in order, streaming a result per test
+// back. The first ranges split a submission evenly across the free slots;
+// a slot that runs dry takes the second half of the range with the most
+// tests left, so a few slow tests do not leave the other slots idle. With
+// stop-on-failure, a failing test cancels the tests after it everywhere,
+// and the report is the same as a local run: the lowest failing test.
+//
+// Ranges name the submission binary and the problem by content hash. A
+// worker fetches what it does not have yet from the coordinator, once, and
+// keeps it under its work directory (problems as the coordinator loaded
+// them: the pack instead of tests/ when there is one). Tests of a node that
+// disconnects go back to the others; when no node is left the coordinator
+// judges locally.
+//
+// Messages are frames of a 4-byte little-endian payload length, a type
+// byte and the payload. Workers authenticate with a shared token
+// ($JUDGE_CLUSTER_TOKEN). Binaries run on the workers as they are, so only
+// connect machines of the same architecture on a trusted network.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bounded_queue.h"
+#include "judge.h"
+#include "report.h"
+#include "sha256.h"
+
+struct ClusterOptions {
+    std::string listen;                // [HOST:]PORT for workers, empty = no cluster
+    std::string token;                 // workers must present it, empty = any
+};
+
+struct WorkerOptions {
+    std::string coordinator;           // HOST:PORT
+    std::filesystem::path workDir;     // fetched problems and binaries
+    std::string token;
+};
+
+inline std::string default_cluster_token() {
+    const char* token = std::getenv("JUDGE_CLUSTER_TOKEN");
+    return token ? token : "";
+}
+
+inline std::filesystem::path default_cluster_work_dir() {
+    return default_compile_cache_dir().parent_path() / "cluster";
+}
+
+namespace cluster_detail {
+
+inline constexpr uint32_t protocolVersion = 1;
+inline constexpr uint32_t maxFrameBytes = 64 << 20;
+inline constexpr size_t chunkBytes = 1 << 20;       // file data per frame
+inline constexpr size_t maxMessageBytes = 4096;     // checker messages in results
+
+enum class Type : uint8_t {
+    Hello = 1,     // worker: version, token, slots, name
+    Welcome,       // coordinator: (empty)
+    Range,         // coordinator: range, job, problem id and hash, binary hash, tests
+    Trim,          // coordinator: range, number of tests to keep
+    Cancel,        // coordinator: job, first test index no longer needed
+    Result,        // worker: range, test, outcome
+    RangeDone,     // worker: range
+    Fetch,         // worker: asset kind, hash
+    FileChunk,     // coordinator: kind, hash, relative path, offset, data
+    AssetEnd,      // coordinator: kind, hash, error ("" = complete)
+};
+
+enum class AssetKind : uint8_t { Problem, Binary };
+
+// Builds one frame.
+class Frame {
+public:
+    explicit Frame(Type type) : bytes_(5, '\0') { bytes_[4] = static_cast<char>(type); }
+
+    Frame& u8(uint8_t value) {
+        bytes_.push_back(static_cast<char>(value));
+        return *this;
+    }
+    Frame& u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) bytes_.push_back(static_cast<char>(value >> (8 * i)));
+        return *this;
+    }
+    Frame& u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) bytes_.push_back(static_cast<char>(value >> (8 * i)));
+        return *this;
+    }
+    Frame& str(std::string_view text) {
+        u32(static_cast<uint32_t>(text.size()));
+        bytes_.append(text);
+        return *this;
+    }
+
+    const std::string& bytes() {
+        uint32_t length = static_cast<uint32_t>(bytes_.size() - 5);
+        for (int i = 0; i < 4; ++i) bytes_[i] = static_cast<char>(length >> (8 * i));
+        return bytes_;
+    }
+
+private:
+    std::string bytes_;
+};
+
+// Reads the fields of a payload in order. Reading past the end yields
+// zeros and empty strings and clears ok().
+class FrameReader {
+public:
+    explicit FrameReader(std::string_view payload) : data_(payload) {}
+
+    uint8_t u8() { return static_cast<uint8_t>(fixed(1)); }
+    uint32_t u32() { return static_cast<uint32_t>(fixed(4)); }
+    uint64_t u64() { return fixed(8); }
+    std::string_view str() {
+        uint32_t size = u32();
+        if (size > data_.size()) return fail();
+        std::string_view text = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return text;
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    uint64_t fixed(size_t size) {
+        if (size > data_.size()) {
+            fail();
+            return 0;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i) value |= static_cast<uint64_t>(static_cast<uint8_t>(data_[i])) << (8 * i);
+        data_.remove_prefix(size);
+        return value;
+    }
+
+    std::string_view fail() {
+        ok_ = false;
+        data_ = {};
+        return {};
+    }
+
+    std::string_view data_;
+    bool ok_ = true;
+};
+
+inline bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+inline bool recv_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Blocks for the next frame. False on EOF, errors and oversized frames.
+inline bool read_frame(int fd, Type& type, std::string& payload) {
+    char header[5];
+    if (!recv_all(fd, header, sizeof(header))) return false;
+    uint32_t length = FrameReader(std::string_view(header, 4)).u32();
+    if (length > maxFrameBytes) return false;
+    type = static_cast<Type>(header[4]);
+    payload.resize(length);
+    return recv_all(fd, payload.data(), length);
+}
+
+// A socket several threads send whole frames on. A frame that cannot be
+// sent ends the connection, so the reader on the other end notices.
+struct Link {
+    int fd = -1;
+    std::mutex writeMutex;
+
+    bool send(Frame& frame) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (send_all(fd, frame.bytes())) return true;
+        shutdown(fd, SHUT_RDWR);
+        return false;
+    }
+};
+
+// Keepalive probes and send timeouts, so that a peer that is unreachable or
+// stopped reading ends the connection instead of blocking it for good.
+inline void configure_link(int fd) {
+    int one = 1, idleSeconds = 30, intervalSeconds = 10, probes = 3;
+    unsigned userTimeoutMs = 60000;
+    timeval sendTimeout{60, 0};
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idleSeconds, sizeof(idleSeconds));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intervalSeconds, sizeof(intervalSeconds));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeoutMs, sizeof(userTimeoutMs));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+}
+
+// Splits "host:port" (or just "port", meaning `defaultHost`).
+inline bool split_address(const std::string& text, const std::string& defaultHost, std::string& host,
+                          std::string& port) {
+    size_t colon = text.rfind(':');
+    host = colon == std::string::npos ? defaultHost : text.substr(0, colon);
+    port = colon == std::string::npos ? text : text.substr(colon + 1);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    return !host.empty() && !port.empty();
+}
+
+// Opens a listening (`passive`) or connected TCP socket. -1 with `error`
+// set on failure.
+inline int open_tcp(const std::string& address, bool passive, std::string& error) {
+    std::string host, port;
+    if (!split_address(address, "127.0.0.1", host, port)) {
+        error = "bad address '" + address + "', expected [HOST:]PORT";
+        return -1;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* found = nullptr;
+    if (int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &found); rc != 0) {
+        error = address + ": " + gai_strerror(rc);
+        return -1;
+    }
+    int fd = -1;
+    error = address + ": no usable address";
+    for (addrinfo* ai = found; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        bool ok;
+        if (passive) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0;
+        } else {
+            ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+            configure_link(fd);
+        }
+        if (!ok) {
+            error = std::string(passive ? "cannot listen on " : "cannot connect to ") + address + ": " +
+                    std::strerror(errno);
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+// Hashes are file names on the workers, so only accept what they look like.
+inline bool valid_hash(std::string_view hash) {
+    return hash.size() == 64 && std::all_of(hash.begin(), hash.end(), [](char c) {
+               return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+           });
+}
+
+inline bool valid_relative_path(const std::filesystem::path& path) {
+    if (path.empty() || path.is_absolute()) return false;
+    for (const auto& part : path) {
+        if (part == "..") return false;
+    }
+    return true;
+}
+
+inline bool hash_file(Sha256& hash, const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> buffer(chunkBytes);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash.update(buffer.data(), static_cast<size_t>(in.gcount()));
+    }
+    return in.eof();
+}
+
+// The files a worker needs to judge a problem the way the coordinator
+// loaded it: its folder, with either the pack or tests/ but not both.
+struct ProblemBundle {
+    int problemID = 0;
+    std::filesystem::path dir;
+    std::vector<std::string> files;    // relative to dir, sorted
+    std::string signature;             // names, sizes and mtimes
+    std::string hash;                  // of names and contents
+};
+
+inline std::shared_ptr<ProblemBundle> list_problem_files(int problemID, const std::filesystem::path& dir,
+                                                         bool fromPack) {
+    auto bundle = std::make_shared<ProblemBundle>();
+    bundle->problemID = problemID;
+    bundle->dir = dir;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        std::filesystem::path relative = it->path().lexically_relative(dir);
+        const std::string top = relative.begin()->string();
+        if (fromPack ? top == "tests" : top == "tests.pack") continue;
+        bundle->files.push_back(relative.generic_string());
+    }
+    std::sort(bundle->files.begin(), bundle->files.end());
+    for (const std::string& file : bundle->files) {
+        struct stat st {};
+        stat((dir / file).c_str(), &st);
+        bundle->signature += file + '\0' + std::to_string(st.st_size) + '\0' + std::to_string(st.st_mtim.tv_sec) +
+                             '.' + std::to_string(st.st_mtim.tv_nsec) + '\n';
+    }
+    return bundle;
+}
+
+} // namespace cluster_detail
+
+// Coordinator side, owned by the judge server.
+class ClusterCoordinator {
+public:
+    ClusterCoordinator(ClusterOptions options, const JudgeOptions& judgeOptions)
+        : options_(std::move(options)), judgeOptions_(judgeOptions) {}
+
+    ClusterCoordinator(const ClusterCoordinator&) = delete;
+    ClusterCoordinator& operator=(const ClusterCoordinator&) = delete;
+
+    ~ClusterCoordinator() { stop(); }
+
+    bool start(std::string& error) {
+        listenFd_ = cluster_detail::open_tcp(options_.listen, true, error);
+        if (listenFd_ < 0) return false;
+        if (pipe2(stopPipe_, O_CLOEXEC) != 0) {
+            error = std::string("pipe: ") + std::strerror(errno);
+            close(listenFd_);
+            listenFd_ = -1;
+            return false;
+        }
+        if (options_.token.empty()) {
+            std::cerr << "Warning: cluster: no JUDGE_CLUSTER_TOKEN set, any worker that connects is accepted\n";
+        }
+        acceptThread_ = std::thread([this] { acceptLoop(); });
+        return true;
+    }
+
+    // Disconnects every worker; submissions still waiting for them are
+    // judged locally by their callers.
+    void stop() {
+        if (!acceptThread_.joinable()) return;
+        char byte = 1;
+        (void)!write(stopPipe_[1], &byte, 1);
+        acceptThread_.join();
+        std::list<std::shared_ptr<Node>> nodes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nodes = nodes_;
+        }
+        for (auto& node : nodes) shutdown(node->link.fd, SHUT_RDWR);
+        for (auto& node : nodes) {
+            if (node->reader.joinable()) node->reader.join();
+            close(node->link.fd);
+        }
+        for (int fd : {listenFd_, stopPipe_[0], stopPipe_[1]}) {
+            if (fd >= 0) close(fd);
+        }
+        listenFd_ = stopPipe_[0] = stopPipe_[1] = -1;
+    }
+
+    size_t nodeCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return readyNodes();
+    }
+
+    unsigned slotCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return totalSlots();
+    }
+
+    // Runs the tests of `problem` against `build` on the workers and fills
+    // in `record` like judgeCompiled(). Returns false without touching
+    // `record` when no worker is connected, or all of them went away before
+    // the result was known; the caller then judges locally.
+    bool judge(SubmissionRecord& record, const LoadedProblem& problem, const CompiledSubmission& build,
+               bool allTests) {
+        if (nodeCount() == 0) return false;
+        TraceSpan span("clusterJudge");
+        auto job = std::make_shared<Job>();
+        job->bundle = bundleFor(problem);
+        Sha256 exeHash;
+        if (!job->bundle || !cluster_detail::hash_file(exeHash, build.exePath)) return false;
+        job->exePath = build.exePath;
+        job->exeHash = exeHash.hexDigest();
+        job->count = problem.testCount();
+        job->stopOnFailure = !allTests;
+        job->firstFailure = job->count;
+        job->outcomes.resize(job->count);
+        // One test with its checker (restarted once) and the fetches
+        // before it.
+        const long wallMs = problem.limits.wallTimeMs > 0 ? problem.limits.wallTimeMs : 600000;
+        job->stallTimeout = std::chrono::milliseconds(wallMs + 2 * checkerTimeoutMs + 30000);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        // The last node may have left while hashing; nothing would then
+        // schedule or abandon the job.
+        if (readyNodes() == 0) return false;
+        job->id = ++lastJob_;
+        std::vector<size_t> order = testOrder(problem, std::max(1u, totalSlots()));
+        if (order.empty()) {
+            for (size_t i = 0; i < job->count; ++i) order.push_back(i);
+        }
+        job->unassigned.assign(order.begin(), order.end());
+        jobs_.push_back(job);
+        Outbox outbox;
+        schedule(outbox);
+        lock.unlock();
+        send(outbox);
+
+        lock.lock();
+        while (!job->finished && !job->abandoned) {
+            changed_.wait_for(lock, std::chrono::seconds(1));
+            disconnectStalled(*job);
+        }
+        jobs_.remove(job);
+        if (job->abandoned) return false;
+        const size_t needed = job->neededCount();
+        lock.unlock();
+
+        record.total = job->count;
+        for (size_t i = 0; i < needed; ++i) recordTest(record, problem, i, *job->outcomes[i]);
+        if (problem.history) problem.history->save();
+        recordVerdict(record, job->firstFailure);
+        return true;
+    }
+
+private:
+    using Frame = cluster_detail::Frame;
+    using Type = cluster_detail::Type;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Node {
+        cluster_detail::Link link;
+        std::string name;
+        unsigned slots = 0;
+        unsigned busy = 0;             // ranges assigned and not done
+        bool ready = false;            // said hello
+        bool stalled = false;          // disconnected for not making progress
+        std::atomic<bool> done{false}; // reader finished
+        std::atomic<Clock::rep> lastSent{0};  // last asset chunk sent to it
+        std::thread reader;
+    };
+
+    struct Job {
+        uint64_t id = 0;
+        std::shared_ptr<const cluster_detail::ProblemBundle> bundle;
+        std::string exePath, exeHash;
+        size_t count = 0;
+        bool stopOnFailure = true;
+        std::deque<size_t> unassigned;                      // test indices in run order
+        std::vector<std::optional<TestOutcome>> outcomes;
+        size_t firstFailure = 0;                            // count = none yet
+        size_t complete = 0;                                // outcomes[0, complete) are in
+        bool finished = false;
+        bool abandoned = false;                             // every node went away
+        Clock::duration stallTimeout{};                     // longest a range may go without a result
+
+        // Tests whose outcome the report needs: up to the first failure.
+        size_t neededCount() const { return stopOnFailure ? std::min(count, firstFailure + 1) : count; }
+    };
+
+    struct Range {
+        uint64_t id = 0;
+        std::shared_ptr<Job> job;
+        std::shared_ptr<Node> node;
+        std::vector<size_t> tests;
+        size_t end = 0;                // tests[end, ...) were given away
+        size_t next = 0;               // tests[0, next) reported or skipped
+        Clock::time_point progress;    // assigned or last result
+    };
+
+    using Outbox = std::vector<std::pair<std::shared_ptr<Node>, Frame>>;
+
+    void send(Outbox& outbox) {
+        for (auto& [node, frame] : outbox) node->link.send(frame);
+    }
+
+    size_t readyNodes() const {
+        return static_cast<size_t>(std::count_if(nodes_.begin(), nodes_.end(), [](const auto& n) { return n->ready; }));
+    }
+
+    unsigned totalSlots() const {
+        unsigned slots = 0;
+        for (const auto& node : nodes_) slots += node->ready ? node->slots : 0;
+        return slots;
+    }
+
+    // The bundle of `problem` as it is on disk now, rehashed only when a
+    // file was added, removed or modified.
+    std::shared_ptr<const cluster_detail::ProblemBundle> bundleFor(const LoadedProblem& problem) {
+        const int id = problem.id;
+        auto bundle = cluster_detail::list_problem_files(id, problemsDir(judgeOptions_) / std::to_string(id),
+                                                         problem.pack != nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = bundles_.find(id);
+            if (it != bundles_.end() && it->second->signature == bundle->signature) return it->second;
+        }
+        Sha256 hash;
+        const std::string name = std::to_string(id);
+        hash.update(name.data(), name.size() + 1);
+        for (const std::string& file : bundle->files) {
+            hash.update(file.data(), file.size() + 1);
+            if (!cluster_detail::hash_file(hash, bundle->dir / file)) {
+                std::cerr << "Warning: cluster: cannot read " << (bundle->dir / file).string() << "\n";
+                return nullptr;
+            }
+        }
+        bundle->hash = hash.hexDigest();
+        std::lock_guard<std::mutex> lock(mutex_);
+        bundles_[id] = bundle;
+        return bundle;
+    }
+
+    // Gives every free slot a range: a share of a submission's tests not
+    // handed out yet, or else half of the longest range still running.
+    void schedule(Outbox& outbox) {
+        for (auto& node : nodes_) {
+            while (node->ready && node->busy < node->slots) {
+                std::optional<Range> range = takeUnassigned();
+                if (!range) range = steal(outbox);
+                if (!range) return;
+                range->id = ++lastRange_;
+                range->node = node;
+                range->end = range->tests.size();
+                range->progress = Clock::now();
+                ++node->busy;
+                const Job& job = *range->job;
+                Frame frame(Type::Range);
+                frame.u64(range->id).u64(job.id).u32(static_cast<uint32_t>(job.bundle->problemID));
+                frame.str(job.bundle->hash).str(job.exeHash).u32(static_cast<uint32_t>(range->tests.size()));
+                for (size_t test : range->tests) frame.u32(static_cast<uint32_t>(test));
+                outbox.emplace_back(node, std::move(frame));
+                ranges_.emplace(range->id, std::move(*range));
+            }
+        }
+    }
+
+    std::optional<Range> takeUnassigned() {
+        const unsigned slots = std::max(1u, totalSlots());
+        for (auto& job : jobs_) {
+            if (job->finished) continue;
+            const size_t needed = job->neededCount();
+            auto& pending = job->unassigned;
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](size_t i) { return i >= needed; }),
+                          pending.end());
+            if (pending.empty()) continue;
+            size_t take = std::min(pending.size(), (pending.size() + slots - 1) / slots);
+            Range range;
+            range.job = job;
+            range.tests.assign(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(take));
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(take));
+            return range;
+        }
+        return std::nullopt;
+    }
+
+    // The running range with the most tests after the one in progress
+    // keeps the first half of them.
+    std::optional<Range> steal(Outbox& outbox) {
+        Range* victim = nullptr;
+        for (auto& [id, range] : ranges_) {
+            if (range.job->finished || range.end < range.next + 2) continue;
+            if (!victim || range.end - range.next > victim->end - victim->next) victim = &range;
+        }
+        if (!victim) return std::nullopt;
+        const size_t keep = victim->next + 1 + (victim->end - victim->next - 1) / 2;
+        Range range;
+        range.job = victim->job;
+        for (size_t k = keep; k < victim->end; ++k) {
+            if (!victim->job->outcomes[victim->tests[k]]) range.tests.push_back(victim->tests[k]);
+        }
+        victim->end = keep;
+        Frame trim(Type::Trim);
+        trim.u64(victim->id).u32(static_cast<uint32_t>(keep));
+        outbox.emplace_back(victim->node, std::move(trim));
+        if (range.tests.empty()) return std::nullopt;
+        return range;
+    }
+
+    // Tells the nodes running tests of `job` that tests from `limit` on are
+    // no longer needed.
+    void cancel(const Job& job, size_t limit, Outbox& outbox) {
+        std::vector<std::shared_ptr<Node>> told;
+        for (auto& [id, range] : ranges_) {
+            if (range.job.get() != &job || std::find(told.begin(), told.end(), range.node) != told.end()) continue;
+            told.push_back(range.node);
+            Frame frame(Type::Cancel);
+            frame.u64(job.id).u32(static_cast<uint32_t>(limit));
+            outbox.emplace_back(range.node, std::move(frame));
+        }
+    }
+
+    void onResult(cluster_detail::FrameReader& in, Outbox& outbox) {
+        const uint64_t rangeId = in.u64();
+        const size_t index = in.u32();
+        TestOutcome outcome;
+        outcome.verdict = static_cast<Verdict>(in.u8());
+        outcome.run.cpuTimeMs = static_cast<long>(in.u64());
+        outcome.run.wallTimeMs = static_cast<long>(in.u64());
+        outcome.run.peakMemoryKb = static_cast<long>(in.u64());
+        outcome.message = in.str();
+        outcome.run.out = in.str();
+        auto it = ranges_.find(rangeId);
+        if (!in.ok() || it == ranges_.end()) return;
+        Range& range = it->second;
+        Job& job = *range.job;
+        range.progress = Clock::now();
+        if (index >= job.count) return;
+        while (range.next < range.tests.size() && range.tests[range.next] != index) ++range.next;
+        ++range.next;
+        if (job.finished || job.outcomes[index]) return;
+        if (!outcome.passed() && index < job.firstFailure) {
+            job.firstFailure = index;
+            if (job.stopOnFailure) cancel(job, index + 1, outbox);
+        }
+        job.outcomes[index] = std::move(outcome);
+        const size_t needed = job.neededCount();
+        while (job.complete < needed && job.outcomes[job.complete]) ++job.complete;
+        if (job.complete >= needed) {
+            job.finished = true;
+            cancel(job, 0, outbox);
+            changed_.notify_all();
+        }
+    }
+
+    void onRangeDone(cluster_detail::FrameReader& in, Outbox& outbox) {
+        auto it = ranges_.find(in.u64());
+        if (!in.ok() || it == ranges_.end()) return;
+        Range& range = it->second;
+        requeue(range);
+        --range.node->busy;
+        ranges_.erase(it);
+        schedule(outbox);
+    }
+
+    // Ends the connection of nodes holding a range of `job` that made no
+    // progress for job.stallTimeout, e.g. because the worker was stopped.
+    // Their reader then hands the tests to the other nodes as usual.
+    void disconnectStalled(const Job& job) {
+        const Clock::time_point now = Clock::now();
+        for (auto& [id, range] : ranges_) {
+            Node& node = *range.node;
+            if (range.job.get() != &job || node.stalled) continue;
+            const Clock::time_point sent{Clock::duration(node.lastSent.load())};
+            if (now - std::max(range.progress, sent) < job.stallTimeout) continue;
+            std::cerr << "Cluster: worker " << node.name << " stopped making progress, disconnecting it\n";
+            node.stalled = true;
+            shutdown(node.link.fd, SHUT_RDWR);
+        }
+    }
+
+    // Puts the tests of `range` that have no outcome yet back in front.
+    void requeue(Range& range) {
+        Job& job = *range.job;
+        if (job.finished) return;
+        for (size_t k = std::min(range.end, range.tests.size()); k-- > 0;) {
+            if (!job.outcomes[range.tests[k]]) job.unassigned.push_front(range.tests[k]);
+        }
+    }
+
+    // Streams a problem bundle or binary to a worker that asked for it.
+    void sendAsset(Node& node, cluster_detail::AssetKind kind, const std::string& hash) {
+        std::vector<std::pair<std::string, std::filesystem::path>> files;   // relative name, source
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& job : jobs_) {
+                if (kind == cluster_detail::AssetKind::Binary && job->exeHash == hash) {
+                    files = {{"", job->exePath}};
+                    break;
+                }
+                if (kind == cluster_detail::AssetKind::Problem && job->bundle->hash == hash) {
+                    // Laid out as <hash>/<id>/..., a problems folder of one.
+                    const std::string prefix = std::to_string(job->bundle->problemID) + "/";
+                    for (const std::string& file : job->bundle->files) {
+                        files.emplace_back(prefix + file, job->bundle->dir / file);
+                    }
+                    break;
+                }
+            }
+        }
+        std::string error = files.empty() ? "unknown " + hash : "";
+        std::vector<char> buffer(cluster_detail::chunkBytes);
+        for (const auto& [name, path] : files) {
+            std::ifstream in(path, std::ios::binary);
+            uint64_t offset = 0;
+            do {
+                in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                size_t got = static_cast<size_t>(in.gcount());
+                Frame chunk(Type::FileChunk);
+                chunk.u8(static_cast<uint8_t>(kind)).str(hash).str(name).u64(offset);
+                chunk.str(std::string_view(buffer.data(), got));
+                if (!node.link.send(chunk)) return;
+                node.lastSent = Clock::now().time_since_epoch().count();
+                offset += got;
+            } while (in);
+            if (!in.eof()) {
+                error = "cannot read " + path.string();
+                break;
+            }
+        }
+        Frame end(Type::AssetEnd);
+        end.u8(static_cast<uint8_t>(kind)).str(hash).str(error);
+        node.link.send(end);
+    }
+
+    void serve(const std::shared_ptr<Node>& node) {
+        Type type;
+        std::string payload;
+        if (cluster_detail::read_frame(node->link.fd, type, payload) && type == Type::Hello) {
+            cluster_detail::FrameReader in(payload);
+            const uint32_t version = in.u32();
+            const std::string token(in.str());
+            node->slots = std::max(1u, in.u32());
+            node->name = in.str();
+            if (!in.ok() || version != cluster_detail::protocolVersion) {
+                std::cerr << "Cluster: rejected a worker speaking another protocol version\n";
+            } else if (!options_.token.empty() && token != options_.token) {
+                std::cerr << "Cluster: rejected worker " << node->name << ": wrong token\n";
+            } else {
+                Frame welcome(Type::Welcome);
+                node->link.send(welcome);
+                Outbox outbox;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    node->ready = true;
+                    schedule(outbox);
+                }
+                send(outbox);
+                std::cerr << "Cluster: worker " << node->name << " joined with " << node->slots << " slot(s)\n";
+            }
+        }
+        while (node->ready && cluster_detail::read_frame(node->link.fd, type, payload)) {
+            cluster_detail::FrameReader in(payload);
+            if (type == Type::Fetch) {
+                auto kind = static_cast<cluster_detail::AssetKind>(in.u8());
+                std::string hash(in.str());
+                if (in.ok()) sendAsset(*node, kind, hash);
+                continue;
+            }
+            Outbox outbox;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (type == Type::Result) onResult(in, outbox);
+                if (type == Type::RangeDone) onRangeDone(in, outbox);
+            }
+            send(outbox);
+        }
+        if (node->ready) std::cerr << "Cluster: worker " << node->name << " left\n";
+        Outbox outbox;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            node->ready = false;
+            for (auto it = ranges_.begin(); it != ranges_.end();) {
+                if (it->second.node == node) {
+                    requeue(it->second);
+                    it = ranges_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            node->busy = 0;
+            if (readyNodes() == 0) {
+                for (auto& job : jobs_) job->abandoned = !job->finished;
+                changed_.notify_all();
+            }
+            schedule(outbox);
+        }
+        send(outbox);
+        node->done = true;
+    }
+
+    void acceptLoop() {
+        while (true) {
+            pollfd fds[2] = {{stopPipe_[0], POLLIN, 0}, {listenFd_, POLLIN, 0}};
+            if (poll(fds, 2, 1000) < 0 && errno != EINTR) return;
+            if (fds[0].revents) return;
+            // Forget nodes whose connection has ended.
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto it = nodes_.begin(); it != nodes_.end();) {
+                    if ((*it)->done) {
+                        (*it)->reader.join();
+                        close((*it)->link.fd);
+                        it = nodes_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            if (!(fds[1].revents & POLLIN)) continue;
+            int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            cluster_detail::configure_link(fd);
+            auto node = std::make_shared<Node>();
+            node->link.fd = fd;
+            std::lock_guard<std::mutex> lock(mutex_);
+            nodes_.push_back(node);
+            node->reader = std::thread([this, node] { serve(node); });
+        }
+    }
+
+    const ClusterOptions options_;
+    const JudgeOptions& judgeOptions_;
+    int listenFd_ = -1;
+    int stopPipe_[2] = {-1, -1};
+    std::thread acceptThread_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::list<std::shared_ptr<Node>> nodes_;
+    std::list<std::shared_ptr<Job>> jobs_;                  // oldest first
+    std::map<uint64_t, Range> ranges_;
+    std::map<int, std::shared_ptr<const cluster_detail::ProblemBundle>> bundles_;   // latest per problem
+    uint64_t lastJob_ = 0;
+    uint64_t lastRange_ = 0;
+};
+
+// Worker side: connects to the coordinator, runs the ranges it is given on
+// `options.jobs` slots and reconnects whenever the connection is lost.
+class ClusterWorker {
+public:
+    ClusterWorker(WorkerOptions worker, const JudgeOptions& options)
+        : worker_(std::move(worker)), options_(options) {
+        if (worker_.workDir.empty()) worker_.workDir = default_cluster_work_dir();
+        options_.useHistory = false;   // the coordinator orders the tests
+        options_.forkServer = false;
+    }
+
+    int run() {
+        std::error_code ec;
+        for (const char* sub : {"problems", "binaries"}) std::filesystem::create_directories(worker_.workDir / sub, ec);
+        if (ec) {
+            std::cerr << "Error: cannot create " << worker_.workDir.string() << ": " << ec.message() << "\n";
+            return 1;
+        }
+        evict(AssetKind::Problem);
+        evict(AssetKind::Binary);
+        bool announced = false;
+        while (true) {
+            std::string error;
+            int fd = cluster_detail::open_tcp(worker_.coordinator, false, error);
+            if (fd >= 0) {
+                announced = false;
+                session(fd);
+                close(fd);
+            } else if (!announced) {
+                std::cerr << error << ", retrying\n";
+                announced = true;
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(2));
+        }
+    }
+
+private:
+    using Frame = cluster_detail::Frame;
+    using Type = cluster_detail::Type;
+    using AssetKind = cluster_detail::AssetKind;
+
+    struct WorkRange {
+        uint64_t id = 0, job = 0;
+        int problemID = 0;
+        std::string problemHash, exeHash;
+        std::vector<size_t> tests;
+        std::atomic<size_t> end{0};
+        std::atomic<size_t> limit{SIZE_MAX};       // tests from here on are not needed
+        std::atomic<size_t> current{SIZE_MAX};     // test being run
+        std::atomic<bool> cancel{false};
+    };
+
+    struct Fetch {
+        bool done = false;
+        std::string error;
+    };
+
+    // One connection: a reader for the coordinator's frames and a thread
+    // per slot running ranges.
+    void session(int fd) {
+        link_.fd = fd;
+        connected_ = true;
+        char host[256] = "worker";
+        gethostname(host, sizeof(host) - 1);
+        const unsigned slots = std::max(1u, options_.jobs);
+        Frame hello(Type::Hello);
+        hello.u32(cluster_detail::protocolVersion).str(worker_.token).u32(slots);
+        hello.str(std::string(host) + ":" + std::to_string(getpid()));
+        Type type;
+        std::string payload;
+        if (!link_.send(hello) || !cluster_detail::read_frame(fd, type, payload) || type != Type::Welcome) {
+            std::cerr << "The coordinator at " << worker_.coordinator << " refused this worker\n";
+            return;
+        }
+        std::cerr << "Connected to " << worker_.coordinator << " with " << slots << " slot(s)\n";
+
+        BoundedQueue<std::shared_ptr<WorkRange>> queue(slots * 2);
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < slots; ++i) {
+            threads.emplace_back([&] {
+                while (auto range = queue.pop()) runRange(**range);
+            });
+        }
+        while (cluster_detail::read_frame(fd, type, payload)) {
+            cluster_detail::FrameReader in(payload);
+            if (type == Type::Range) {
+                auto range = std::make_shared<WorkRange>();
+                range->id = in.u64();
+                range->job = in.u64();
+                range->problemID = static_cast<int>(in.u32());
+                range->problemHash = in.str();
+                range->exeHash = in.str();
+                range->tests.resize(in.u32());
+                for (size_t& test : range->tests) test = in.u32();
+                range->end = range->tests.size();
+                if (!in.ok()) break;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    ranges_[range->id] = range;
+                }
+                queue.push(std::move(range));
+            } else if (type == Type::Trim) {
+                uint64_t id = in.u64();
+                size_t keep = in.u32();
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (auto it = ranges_.find(id); it != ranges_.end()) {
+                    it->second->end = std::min<size_t>(it->second->end, keep);
+                }
+            } else if (type == Type::Cancel) {
+                uint64_t job = in.u64();
+                size_t limit = in.u32();
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto& [id, range] : ranges_) {
+                    if (range->job != job) continue;
+                    range->limit = std::min<size_t>(range->limit, limit);
+                    size_t running = range->current.load();
+                    if (running != SIZE_MAX && running >= limit) range->cancel = true;
+                }
+            } else if (type == Type::FileChunk) {
+                if (!onChunk(in)) break;
+            } else if (type == Type::AssetEnd) {
+                onAssetEnd(in);
+            }
+        }
+
+        std::cerr << "Lost the connection to " << worker_.coordinator << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connected_ = false;
+            for (auto& [id, range] : ranges_) {
+                range->limit = 0;
+                range->cancel = true;
+            }
+            fetches_.clear();
+        }
+        changed_.notify_all();
+        shutdown(fd, SHUT_RDWR);
+        queue.close();
+        for (auto& t : threads) t.join();
+        ranges_.clear();
+        chunkFile_.close();
+    }
+
+    void runRange(WorkRange& range) {
+        std::string error;
+        std::shared_ptr<const LoadedProblem> problem = problemFor(range, error);
+        const std::string exe = problem ? fetch(AssetKind::Binary, range.exeHash, error) : "";
+        if (!problem || exe.empty()) {
+            TestOutcome failed;
+            failed.message = error;
+            for (size_t k = 0; k < range.end.load(); ++k) {
+                if (range.tests[k] < range.limit.load()) sendResult(range, range.tests[k], failed);
+            }
+        } else {
+            TestPrefetcher tests(range.tests.size(), testReadAhead,
+                                 [&](size_t k) { return problem->loadTest(range.tests[k]); });
+            for (size_t k = 0; k < range.end.load() && connected_; ++k) {
+                const size_t index = range.tests[k];
+                // Publish the test before checking the limit, so a Cancel
+                // either sees it or is seen here.
+                range.cancel = false;
+                range.current = index;
+                if (index >= range.limit.load()) {
+                    range.current = SIZE_MAX;
+                    continue;
+                }
+                TraceSpan span("test", "test", static_cast<int64_t>(index + 1));
+                std::shared_ptr<const LoadedTest> test = tests.acquire(k);
+                TestOutcome outcome;
+                do {
+                    range.cancel = false;
+                    if (test->error.empty()) {
+                        outcome = runTestCase(exe, *problem, test->data, &range.cancel);
+                    } else {
+                        outcome.message = test->error;
+                    }
+                    // A cancel meant for the previous test may land on this one.
+                } while (outcome.run.cancelled && index < range.limit.load());
+                tests.release(k);
+                range.current = SIZE_MAX;
+                span.detail(outcome.run.cancelled ? "cancelled" : verdict_code(outcome.verdict));
+                if (!outcome.run.cancelled) sendResult(range, index, outcome);
+            }
+        }
+        Frame done(Type::RangeDone);
+        done.u64(range.id);
+        link_.send(done);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ranges_.erase(range.id);
+    }
+
+    void sendResult(const WorkRange& range, size_t index, const TestOutcome& outcome) {
+        std::string_view message = outcome.message;
+        if (message.empty() && outcome.verdict == Verdict::JudgeError) message = outcome.run.error;
+        Frame result(Type::Result);
+        result.u64(range.id).u32(static_cast<uint32_t>(index)).u8(static_cast<uint8_t>(outcome.verdict));
+        result.u64(static_cast<uint64_t>(outcome.run.cpuTimeMs)).u64(static_cast<uint64_t>(outcome.run.wallTimeMs));
+        result.u64(static_cast<uint64_t>(outcome.run.peakMemoryKb));
+        result.str(message.substr(0, cluster_detail::maxMessageBytes));
+        result.str(outcome.verdict == Verdict::WrongAnswer
+                       ? std::string_view(outcome.run.out).substr(0, reportedOutputBytes)
+                       : std::string_view());
+        link_.send(result);
+    }
+
+    // Problems are loaded once per content hash, from the folder fetched
+    // for that hash.
+    std::shared_ptr<const LoadedProblem> problemFor(const WorkRange& range, std::string& error) {
+        const std::string root = fetch(AssetKind::Problem, range.problemHash, error);
+        if (root.empty()) return nullptr;
+        std::lock_guard<std::mutex> lock(problemsMutex_);
+        auto& problem = problems_[range.problemHash];
+        if (!problem) {
+            JudgeOptions options = options_;
+            options.problemsDir = root;
+            problem = loadProblem(range.problemID, options);
+        }
+        return problem;
+    }
+
+    std::filesystem::path assetPath(AssetKind kind, const std::string& hash) const {
+        return worker_.workDir / (kind == AssetKind::Problem ? "problems" : "binaries") / hash;
+    }
+
+    // Path of the asset, fetched from the coordinator unless an earlier
+    // fetch (possibly by an earlier run of the worker) left it on disk.
+    // "" with `error` set if it cannot be had.
+    std::string fetch(AssetKind kind, const std::string& hash, std::string& error) {
+        if (!cluster_detail::valid_hash(hash)) {
+            error = "invalid asset hash";
+            return "";
+        }
+        const std::filesystem::path path = assetPath(kind, hash);
+        std::error_code ec;
+        {
+            std::lock_guard<std::mutex> assets(assetsMutex_);
+            if (std::filesystem::exists(path, ec)) {
+                std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+                return path.string();
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::shared_ptr<Fetch>& entry = fetches_[hash];
+        const bool first = !entry;
+        if (first) entry = std::make_shared<Fetch>();
+        std::shared_ptr<Fetch> state = entry;
+        if (first) {
+            lock.unlock();
+            std::filesystem::remove_all(path.string() + ".part", ec);
+            Frame request(Type::Fetch);
+            request.u8(static_cast<uint8_t>(kind)).str(hash);
+            link_.send(request);
+            lock.lock();
+        }
+        changed_.wait(lock, [&] { return !connected_ || state->done; });
+        if (!connected_) {
+            error = "lost the connection to the coordinator";
+            return "";
+        }
+        if (!state->error.empty()) {
+            // The next range asks again; the coordinator may have it by then.
+            if (fetches_[hash] == state) fetches_.erase(hash);
+            error = state->error;
+            return "";
+        }
+        // On disk now; a later fetch after eviction starts over.
+        if (fetches_[hash] == state) fetches_.erase(hash);
+        lock.unlock();
+        evict(kind);
+        return path.string();
+    }
+
+    // Removes the least recently used assets of `kind` that no range
+    // needs until the folder fits options.cacheMaxBytes (--cache-size).
+    void evict(AssetKind kind) {
+        if (options_.cacheMaxBytes == 0) return;
+        std::set<std::string> inUse;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& [id, range] : ranges_) {
+                inUse.insert(kind == AssetKind::Problem ? range->problemHash : range->exeHash);
+            }
+        }
+        std::lock_guard<std::mutex> assets(assetsMutex_);
+        struct Entry {
+            std::filesystem::path path;
+            uint64_t size;
+            std::filesystem::file_time_type used;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(assetPath(kind, "").parent_path(), ec)) {
+            const std::string name = entry.path().filename().string();
+            if (!cluster_detail::valid_hash(name)) continue;   // .part files are still being written
+            uint64_t size = 0;
+            if (entry.is_directory(ec)) {
+                for (const auto& file : std::filesystem::recursive_directory_iterator(entry.path(), ec)) {
+                    if (file.is_regular_file(ec)) size += file.file_size(ec);
+                }
+            } else {
+                size = entry.file_size(ec);
+            }
+            total += size;
+            if (!inUse.count(name)) entries.push_back({entry.path(), size, entry.last_write_time(ec)});
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const Entry& entry : entries) {
+            if (total <= options_.cacheMaxBytes) break;
+            std::filesystem::remove_all(entry.path, ec);
+            if (ec) continue;
+            total -= entry.size;
+            if (kind == AssetKind::Problem) {
+                std::lock_guard<std::mutex> lock(problemsMutex_);
+                problems_.erase(entry.path.filename().string());
+            }
+        }
+    }
+
+    // Chunks go to <asset>.part, renamed into place once complete.
+    bool onChunk(cluster_detail::FrameReader& in) {
+        auto kind = static_cast<AssetKind>(in.u8());
+        std::string hash(in.str());
+        std::filesystem::path name(std::string(in.str()));
+        uint64_t offset = in.u64();
+        std::string_view data = in.str();
+        if (!in.ok() || !cluster_detail::valid_hash(hash)) return false;
+        std::filesystem::path part = assetPath(kind, hash).string() + ".part";
+        if (kind == AssetKind::Problem) {
+            if (!cluster_detail::valid_relative_path(name)) return false;
+            part /= name;
+        }
+        if (offset == 0 || part != chunkPath_) {
+            chunkFile_.close();
+            std::error_code ec;
+            std::filesystem::create_directories(part.parent_path(), ec);
+            chunkFile_.open(part, std::ios::binary | std::ios::trunc);
+            chunkPath_ = part;
+        }
+        chunkFile_.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return true;
+    }
+
+    void onAssetEnd(cluster_detail::FrameReader& in) {
+        auto kind = static_cast<AssetKind>(in.u8());
+        std::string hash(in.str());
+        std::string error(in.str());
+        if (!in.ok() || !cluster_detail::valid_hash(hash)) return;
+        const bool written = chunkFile_.good();
+        chunkFile_.close();
+        chunkPath_.clear();
+        const std::filesystem::path path = assetPath(kind, hash);
+        const std::filesystem::path part = path.string() + ".part";
+        std::error_code ec;
+        if (error.empty() && !written) error = "cannot write " + part.string();
+        if (error.empty() && kind == AssetKind::Problem) std::filesystem::create_directories(part, ec);
+        if (error.empty() && kind == AssetKind::Binary) chmod(part.c_str(), 0755);
+        if (error.empty()) std::filesystem::rename(part, path, ec);
+        if (error.empty() && ec) error = "cannot store " + path.string() + ": " + ec.message();
+        if (!error.empty()) std::filesystem::remove_all(part, ec);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto it = fetches_.find(hash); it != fetches_.end()) {
+            it->second->done = true;
+            it->second->error = error;
+        }
+        changed_.notify_all();
+    }
+
+    WorkerOptions worker_;
+    JudgeOptions options_;
+    cluster_detail::Link link_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::atomic<bool> connected_{false};
+    std::map<uint64_t, std::shared_ptr<WorkRange>> ranges_;
+    std::map<std::string, std::shared_ptr<Fetch>> fetches_;
+
+    std::ofstream chunkFile_;                  // only the reader writes assets
+    std::filesystem::path chunkPath_;
+
+    std::mutex problemsMutex_;
+    std::map<std::string, std::shared_ptr<const LoadedProblem>> problems_;
+
+    std::mutex assetsMutex_;                   // eviction against reuse of assets on disk
+};
+
+inline int run_cluster_worker(const WorkerOptions& worker, const JudgeOptions& options) {
+    return ClusterWorker(worker, options).run();
+}
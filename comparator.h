@@ -0,0 +1,434 @@
+#pragma once
+
+// Output comparison that runs while the submission is still writing. The
+// runner hands every chunk of stdout to feed() as it arrives; as soon as a
+// mismatch is certain feed() returns false and the submission is killed,
+// so a wrong answer never has to be buffered or run to completion.
+//
+// How outputs are compared is chosen per problem ("compare" in info.json).
+// Each policy is its own comparator class; the virtual call happens once
+// per chunk, and inside a chunk the work is memchr/memcmp plus a SIMD scan
+// for whitespace.
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum class ComparePolicy {
+    Trimmed,   // equal after removing leading and trailing whitespace
+    Exact,     // byte for byte
+    Lines,     // line by line, ignoring trailing whitespace and blank lines at the end
+    Tokens,    // whitespace-separated tokens
+    Float,     // tokens, numbers compared with a tolerance
+};
+
+inline const char* compare_policy_name(ComparePolicy policy) {
+    switch (policy) {
+        case ComparePolicy::Trimmed: return "trimmed";
+        case ComparePolicy::Exact: return "exact";
+        case ComparePolicy::Lines: return "lines";
+        case ComparePolicy::Tokens: return "tokens";
+        case ComparePolicy::Float: return "float";
+    }
+    return "trimmed";
+}
+
+inline std::optional<ComparePolicy> parse_compare_policy(std::string_view name) {
+    for (ComparePolicy policy : {ComparePolicy::Trimmed, ComparePolicy::Exact, ComparePolicy::Lines,
+                                 ComparePolicy::Tokens, ComparePolicy::Float}) {
+        if (name == compare_policy_name(policy)) return policy;
+    }
+    return std::nullopt;
+}
+
+// Per-problem comparison settings.
+struct CompareOptions {
+    ComparePolicy policy = ComparePolicy::Trimmed;
+    double absoluteError = 1e-6;   // Float: accepted if within either error
+    double relativeError = 1e-6;
+};
+
+class OutputComparator {
+public:
+    virtual ~OutputComparator() = default;
+
+    // Consumes the next chunk of output. Returns false once the output can
+    // no longer match, after which the comparator is not fed again.
+    virtual bool feed(std::string_view chunk) = 0;
+
+    // Called after the last chunk. Returns whether the output matched.
+    virtual bool finish() = 0;
+
+    // Where the output went wrong, if the comparator can tell.
+    virtual std::string mismatch() const { return {}; }
+};
+
+namespace compare_detail {
+
+// Blank characters: ' ', '\t' and '\r', plus '\n' when WithNewline.
+template <bool WithNewline>
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || (WithNewline && c == '\n');
+}
+
+#if defined(__SSE2__)
+// Bit i is set if p[i] is blank, for 16 bytes.
+template <bool WithNewline>
+inline unsigned blank_mask(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    if constexpr (WithNewline) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+#endif
+
+// First blank character in [p, end), or end.
+template <bool WithNewline>
+inline const char* find_blank(const char* p, const char* end) {
+#if defined(__SSE2__)
+    for (; end - p >= 16; p += 16) {
+        if (unsigned mask = blank_mask<WithNewline>(p)) return p + __builtin_ctz(mask);
+    }
+#endif
+    while (p < end && !is_blank<WithNewline>(*p)) ++p;
+    return p;
+}
+
+// First non-blank character in [p, end), or end.
+template <bool WithNewline>
+inline const char* skip_blank(const char* p, const char* end) {
+#if defined(__SSE2__)
+    for (; end - p >= 16; p += 16) {
+        if (unsigned mask = ~blank_mask<WithNewline>(p) & 0xFFFFu) return p + __builtin_ctz(mask);
+    }
+#endif
+    while (p < end && is_blank<WithNewline>(*p)) ++p;
+    return p;
+}
+
+// Length of the common prefix of a and b, both at least n bytes long.
+inline size_t common_prefix(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (unsigned diff = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xFFFFu) {
+            return i + __builtin_ctz(diff);
+        }
+    }
+#endif
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+} // namespace compare_detail
+
+// Byte-for-byte equality.
+class ExactComparator final : public OutputComparator {
+public:
+    explicit ExactComparator(std::string_view expected) : expected_(expected) {}
+
+    bool feed(std::string_view chunk) override {
+        if (chunk.size() > expected_.size() - matched_) return false;
+        if (std::memcmp(chunk.data(), expected_.data() + matched_, chunk.size()) != 0) return false;
+        matched_ += chunk.size();
+        return true;
+    }
+
+    bool finish() override { return matched_ == expected_.size(); }
+
+private:
+    std::string_view expected_;
+    size_t matched_ = 0;
+};
+
+// The output must equal the expected output once leading and trailing
+// whitespace is removed from both. Inner whitespace must match exactly.
+class TrimmedComparator final : public OutputComparator {
+public:
+    explicit TrimmedComparator(std::string_view expected) {
+        using compare_detail::is_blank;
+        size_t first = 0, last = expected.size();
+        while (first < last && is_blank<true>(expected[first])) ++first;
+        while (last > first && is_blank<true>(expected[last - 1])) --last;
+        expected_ = expected.substr(first, last - first);
+    }
+
+    bool feed(std::string_view chunk) override {
+        const char* p = chunk.data();
+        const char* end = p + chunk.size();
+        if (!started_) {
+            p = compare_detail::skip_blank<true>(p, end);
+            if (p == end) return true;
+            started_ = true;
+        }
+        // Bulk-compare the part that overlaps the rest of the expected output.
+        size_t overlap = std::min(static_cast<size_t>(end - p), expected_.size() - matched_);
+        if (std::memcmp(p, expected_.data() + matched_, overlap) != 0) return false;
+        matched_ += overlap;
+        p += overlap;
+        // Past the end of the expected output only trailing whitespace may follow.
+        return compare_detail::skip_blank<true>(p, end) == end;
+    }
+
+    bool finish() override { return matched_ == expected_.size(); }
+
+private:
+    std::string_view expected_;
+    size_t matched_ = 0;
+    bool started_ = false;   // leading whitespace has been skipped
+};
+
+// Line by line. Trailing ' ', '\t' and '\r' on each line are ignored, and
+// so are blank lines at the end of either output.
+class LinesComparator final : public OutputComparator {
+public:
+    explicit LinesComparator(std::string_view expected) : expected_(expected) { startLine(0); }
+
+    bool feed(std::string_view chunk) override {
+        const char* p = chunk.data();
+        const char* end = p + chunk.size();
+        while (p < end) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            const char* lineEnd = newline ? newline : end;
+            // The line so far must be a prefix of the expected (trimmed)
+            // line, and anything beyond it trailing whitespace.
+            size_t overlap = std::min(static_cast<size_t>(lineEnd - p), trimmedEnd_ - matched_);
+            if (std::memcmp(p, expected_.data() + matched_, overlap) != 0) return false;
+            matched_ += overlap;
+            p += overlap;
+            if (compare_detail::skip_blank<false>(p, lineEnd) != lineEnd) return false;
+            p = lineEnd;
+            if (newline) {
+                if (matched_ != trimmedEnd_) return false;
+                startLine(lineEnd_ < expected_.size() ? lineEnd_ + 1 : expected_.size());
+                ++p;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override {
+        if (matched_ != trimmedEnd_) return false;
+        const char* rest = expected_.data() + lineEnd_;
+        const char* end = expected_.data() + expected_.size();
+        return compare_detail::skip_blank<true>(rest, end) == end;
+    }
+
+private:
+    void startLine(size_t start) {
+        size_t newline = expected_.find('\n', start);
+        lineEnd_ = newline == std::string_view::npos ? expected_.size() : newline;
+        trimmedEnd_ = lineEnd_;
+        while (trimmedEnd_ > start && compare_detail::is_blank<false>(expected_[trimmedEnd_ - 1])) --trimmedEnd_;
+        matched_ = start;
+    }
+
+    std::string_view expected_;
+    size_t matched_ = 0;      // expected bytes of the current line matched so far
+    size_t trimmedEnd_ = 0;   // end of the current expected line without trailing blanks
+    size_t lineEnd_ = 0;      // its '\n' (or the end of the expected output)
+};
+
+// Whitespace-separated tokens must be equal; the amount and kind of
+// whitespace between them does not matter.
+class TokensComparator final : public OutputComparator {
+public:
+    explicit TokensComparator(std::string_view expected) : expected_(expected) {}
+
+    bool feed(std::string_view chunk) override {
+        using compare_detail::find_blank;
+        using compare_detail::skip_blank;
+        const char* p = chunk.data();
+        const char* end = p + chunk.size();
+        const char* expectedEnd = expected_.data() + expected_.size();
+        while (p < end) {
+            // Stretches where the output is byte-identical to the expected
+            // output (the usual case) are taken in one SIMD pass.
+            size_t same = compare_detail::common_prefix(
+                p, expected_.data() + matched_, std::min(static_cast<size_t>(end - p), expected_.size() - matched_));
+            if (same > 0) {
+                p += same;
+                matched_ += same;
+                inToken_ = !compare_detail::is_blank<true>(p[-1]);
+                if (p == end) break;
+            }
+            if (!inToken_) {
+                p = skip_blank<true>(p, end);
+                if (p == end) break;
+                // A new token starts; the expected output must have one too.
+                matched_ = static_cast<size_t>(skip_blank<true>(expected_.data() + matched_, expectedEnd) -
+                                               expected_.data());
+                if (matched_ == expected_.size()) return false;
+                inToken_ = true;
+            }
+            const char* tokenEnd = find_blank<true>(p, end);
+            size_t length = static_cast<size_t>(tokenEnd - p);
+            if (length > expected_.size() - matched_ ||
+                std::memcmp(p, expected_.data() + matched_, length) != 0) {
+                return false;
+            }
+            matched_ += length;
+            p = tokenEnd;
+            if (p < end) {
+                // The token ended here, so the expected one must end too.
+                if (!tokenEndsAt(matched_)) return false;
+                inToken_ = false;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override {
+        if (inToken_ && !tokenEndsAt(matched_)) return false;
+        const char* end = expected_.data() + expected_.size();
+        return compare_detail::skip_blank<true>(expected_.data() + matched_, end) == end;
+    }
+
+private:
+    bool tokenEndsAt(size_t pos) const {
+        return pos == expected_.size() || compare_detail::is_blank<true>(expected_[pos]);
+    }
+
+    std::string_view expected_;
+    size_t matched_ = 0;
+    bool inToken_ = false;   // the output stopped in the middle of a token
+};
+
+// Token by token like TokensComparator, except that where the expected
+// token is a number the output token must be a number within the absolute
+// or relative error of it. Numbers are parsed with std::from_chars straight
+// from the chunk; only a token split across two chunks is copied.
+class FloatComparator final : public OutputComparator {
+public:
+    FloatComparator(std::string_view expected, double absoluteError, double relativeError)
+        : expected_(expected), absoluteError_(absoluteError), relativeError_(relativeError) {}
+
+    bool feed(std::string_view chunk) override {
+        using compare_detail::find_blank;
+        using compare_detail::skip_blank;
+        const char* p = chunk.data();
+        const char* end = p + chunk.size();
+        while (p < end) {
+            if (!inToken_) {
+                p = skip_blank<true>(p, end);
+                if (p == end) break;
+                if (!nextExpected()) {
+                    ++tokenIndex_;
+                    return fail("unexpected extra output", std::string_view(p, find_blank<true>(p, end) - p));
+                }
+                inToken_ = true;
+            }
+            const char* tokenEnd = find_blank<true>(p, end);
+            if (tokenEnd == end) {
+                // The token may continue in the next chunk.
+                carry_.append(p, static_cast<size_t>(end - p));
+                if (carry_.size() > std::max<size_t>(maxNumberBytes, expectedToken_.size())) {
+                    return fail("token too long", std::string_view(carry_).substr(0, 32));
+                }
+                break;
+            }
+            std::string_view token(p, static_cast<size_t>(tokenEnd - p));
+            if (!carry_.empty()) {
+                carry_.append(token);
+                token = carry_;
+            }
+            if (!matchToken(token)) return false;
+            carry_.clear();
+            inToken_ = false;
+            p = tokenEnd;
+        }
+        return true;
+    }
+
+    bool finish() override {
+        if (inToken_) {
+            if (!matchToken(carry_)) return false;
+            inToken_ = false;
+        }
+        if (nextExpected()) return fail("expected " + shorten(expectedToken_) + ", but the output ended", {});
+        return true;
+    }
+
+    std::string mismatch() const override { return mismatch_; }
+
+private:
+    static constexpr size_t maxNumberBytes = 4096;
+
+    // Moves to the next expected token; false if there is none.
+    bool nextExpected() {
+        const char* end = expected_.data() + expected_.size();
+        const char* start = compare_detail::skip_blank<true>(expected_.data() + position_, end);
+        if (start == end) return false;
+        const char* stop = compare_detail::find_blank<true>(start, end);
+        expectedToken_ = std::string_view(start, static_cast<size_t>(stop - start));
+        position_ = static_cast<size_t>(stop - expected_.data());
+        ++tokenIndex_;
+        return true;
+    }
+
+    static bool parseNumber(std::string_view token, double& value) {
+        const char* first = token.data();
+        const char* last = first + token.size();
+        if (first < last && *first == '+') ++first;
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        return ec == std::errc() && ptr == last;
+    }
+
+    bool matchToken(std::string_view token) {
+        double expectedValue, value;
+        if (!parseNumber(expectedToken_, expectedValue)) {
+            return token == expectedToken_ || fail("expected " + shorten(expectedToken_), token);
+        }
+        if (!parseNumber(token, value)) return fail("expected the number " + shorten(expectedToken_), token);
+        if (std::isnan(expectedValue) || std::isinf(expectedValue)) {
+            bool same = std::isnan(expectedValue) ? std::isnan(value) : value == expectedValue;
+            return same || fail("expected " + shorten(expectedToken_), token);
+        }
+        double difference = std::fabs(value - expectedValue);
+        if (difference <= absoluteError_ || difference <= relativeError_ * std::fabs(expectedValue)) return true;
+        return fail("expected " + shorten(expectedToken_), token);
+    }
+
+    static std::string shorten(std::string_view token) {
+        return token.size() <= 64 ? std::string(token) : std::string(token.substr(0, 64)) + "...";
+    }
+
+    bool fail(const std::string& what, std::string_view found) {
+        mismatch_ = "token " + std::to_string(tokenIndex_) + ": " + what;
+        if (!found.empty()) mismatch_ += ", found " + shorten(found);
+        return false;
+    }
+
+    std::string_view expected_;
+    double absoluteError_;
+    double relativeError_;
+    size_t position_ = 0;              // end of expectedToken_ in expected_
+    std::string_view expectedToken_;   // the token the output is compared with
+    size_t tokenIndex_ = 0;            // 1-based index of expectedToken_
+    bool inToken_ = false;             // an output token is in progress
+    std::string carry_;                // output token split across chunks
+    std::string mismatch_;
+};
+
+inline std::unique_ptr<OutputComparator> make_comparator(const CompareOptions& options, std::string_view expected) {
+    switch (options.policy) {
+        case ComparePolicy::Exact: return std::make_unique<ExactComparator>(expected);
+        case ComparePolicy::Lines: return std::make_unique<LinesComparator>(expected);
+        case ComparePolicy::Tokens: return std::make_unique<TokensComparator>(expected);
+        case ComparePolicy::Float:
+            return std::make_unique<FloatComparator>(expected, options.absoluteError, options.relativeError);
+        case ComparePolicy::Trimmed: break;
+    }
+    return std::make_unique<TrimmedComparator>(expected);
+}
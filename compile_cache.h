@@ -0,0 +1,215 @@
+#pragma once
+
+// Content-addressed cache of compiled submissions. A binary is stored under
+// the SHA-256 of the compiler identity, the compile flags and the source
+// bytes, so judging the same file again (or against another problem) skips
+// the compile entirely.
+//
+// Layout: <dir>/<key> holds the binary, <dir>/.lock serializes inserts and
+// eviction. Entries are published with rename(), so readers never see a
+// partially written binary. A reader keeps a shared flock() on the entry it
+// is running; eviction skips entries it cannot lock exclusively. The least
+// recently used entries (by mtime, refreshed on every hit) are evicted once
+// the cache grows past its size bound.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "process_runner.h"
+#include "sha256.h"
+
+// Default location: $XDG_CACHE_HOME/cpp-judge/binaries or ~/.cache/...
+inline std::filesystem::path default_compile_cache_dir() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::filesystem::path(xdg) / "cpp-judge" / "binaries";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "cpp-judge" / "binaries";
+    }
+    return std::filesystem::temp_directory_path() / "cpp-judge" / "binaries";
+}
+
+// Identifies the compiler binary without running it: resolved path, size and
+// modification time. Upgrading the toolchain changes the identity.
+inline std::string compiler_identity(const std::string& compiler) {
+    std::string resolved = resolve_executable(compiler);
+    std::error_code ec;
+    std::filesystem::path canonical = std::filesystem::canonical(resolved, ec);
+    if (!ec) resolved = canonical.string();
+    struct stat st {};
+    if (stat(resolved.c_str(), &st) != 0) return resolved;
+    return resolved + "|" + std::to_string(st.st_size) + "|" + std::to_string(st.st_mtim.tv_sec) + "." +
+           std::to_string(st.st_mtim.tv_nsec);
+}
+
+// A cached binary in use. Holds a shared lock so the entry is not evicted
+// while tests are still being run from it.
+class CacheLease {
+public:
+    CacheLease(std::filesystem::path path, int fd) : path_(std::move(path)), fd_(fd) {}
+    CacheLease(CacheLease&& other) noexcept : path_(std::move(other.path_)), fd_(other.fd_) { other.fd_ = -1; }
+    CacheLease& operator=(CacheLease&& other) noexcept {
+        if (this != &other) {
+            release();
+            path_ = std::move(other.path_);
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+    CacheLease(const CacheLease&) = delete;
+    CacheLease& operator=(const CacheLease&) = delete;
+    ~CacheLease() { release(); }
+
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    void release() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+    }
+
+    std::filesystem::path path_;
+    int fd_;
+};
+
+class CompileCache {
+public:
+    CompileCache(std::filesystem::path dir, uint64_t maxBytes) : dir_(std::move(dir)), maxBytes_(maxBytes) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        usable_ = !ec && access(dir_.c_str(), W_OK) == 0;
+    }
+
+    bool usable() const { return usable_; }
+    const std::filesystem::path& dir() const { return dir_; }
+
+    // `flags` must not contain the source or output paths.
+    static std::string key(const std::string& compiler, const std::vector<std::string>& flags,
+                           std::string_view source) {
+        static const char version[] = "cpp-judge-cache-v1";
+        Sha256 hash;
+        hash.update(version, sizeof(version));
+        std::string identity = compiler_identity(compiler);
+        hash.update(identity.data(), identity.size() + 1);
+        for (const auto& flag : flags) hash.update(flag.data(), flag.size() + 1);
+        hash.update("", 1);
+        hash.update(source);
+        return hash.hexDigest();
+    }
+
+    // Looks up a binary and, on a hit, marks it as recently used.
+    std::optional<CacheLease> lookup(const std::string& key) const {
+        if (!usable_) return std::nullopt;
+        std::filesystem::path path = dir_ / key;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+        if (flock(fd, LOCK_SH) != 0) {
+            close(fd);
+            return std::nullopt;
+        }
+        // Eviction may have unlinked the file between open() and flock().
+        struct stat opened {}, current {};
+        if (fstat(fd, &opened) != 0 || stat(path.c_str(), &current) != 0 || opened.st_ino != current.st_ino) {
+            close(fd);
+            return std::nullopt;
+        }
+        futimens(fd, nullptr);
+        return CacheLease(path, fd);
+    }
+
+    // Path a new binary should be compiled to before insert(); it lives in
+    // the cache directory so that insert() is a same-filesystem rename.
+    std::filesystem::path stagingPath() const {
+        static std::atomic<unsigned> counter{0};
+        return dir_ / (".tmp-" + std::to_string(getpid()) + "-" + std::to_string(counter++));
+    }
+
+    // Publishes a binary built at `staged` and returns a lease on it. If
+    // another process inserted the same key first, it is replaced; leases
+    // on the old copy keep running it, since rename() leaves it intact
+    // until they close it.
+    std::optional<CacheLease> insert(const std::string& key, const std::filesystem::path& staged) {
+        std::error_code ec;
+        {
+            LockFile lock(dir_);
+            std::filesystem::rename(staged, dir_ / key, ec);
+        }
+        if (ec) std::filesystem::remove(staged, ec);
+        auto lease = lookup(key);
+        evict();
+        return lease;
+    }
+
+    // Removes least recently used entries until the cache fits its bound.
+    void evict() {
+        if (!usable_ || maxBytes_ == 0) return;
+        LockFile lock(dir_);
+
+        struct Entry {
+            std::filesystem::path path;
+            uint64_t size;
+            std::filesystem::file_time_type used;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code ec;
+        const auto staleBefore = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+        for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind(".tmp-", 0) == 0 && entry.last_write_time(ec) < staleBefore) {
+                std::filesystem::remove(entry.path(), ec);  // left behind by a crashed compile
+                continue;
+            }
+            if (name.empty() || name[0] == '.' || !entry.is_regular_file(ec)) continue;
+            uint64_t size = entry.file_size(ec);
+            entries.push_back({entry.path(), size, entry.last_write_time(ec)});
+            total += size;
+        }
+        if (total <= maxBytes_) return;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const auto& entry : entries) {
+            if (total <= maxBytes_) break;
+            int fd = open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+            // Entries being run by someone else are skipped.
+            if (flock(fd, LOCK_EX | LOCK_NB) == 0 && unlink(entry.path.c_str()) == 0) total -= entry.size;
+            close(fd);
+        }
+    }
+
+private:
+    // Exclusive lock on <dir>/.lock for the lifetime of the object.
+    class LockFile {
+    public:
+        explicit LockFile(const std::filesystem::path& dir) {
+            fd_ = open((dir / ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ >= 0) flock(fd_, LOCK_EX);
+        }
+        ~LockFile() {
+            if (fd_ >= 0) close(fd_);
+        }
+        LockFile(const LockFile&) = delete;
+        LockFile& operator=(const LockFile&) = delete;
+
+    private:
+        int fd_;
+    };
+
+    std::filesystem::path dir_;
+    uint64_t maxBytes_;
+    bool usable_ = false;
+};
@@ -0,0 +1,130 @@
+import 'dart:convert';
+import 'dart:io';
+import 'dart:typed_data';
+import 'package:crypto/crypto.dart';
+import 'package:path/path.dart' as path;
+
+/// Persistent cache of compiled submissions, keyed by the SHA-256 of the
+/// compiler identity, the compile flags and the source code. Uses the same
+/// layout as the CLI judge (compile_cache.h): one binary per key, least
+/// recently used entries evicted above [maxBytes]. It lives in its own
+/// directory, since the CLI judge runs binaries straight out of its cache
+/// under flock() leases this cache does not take.
+///
+/// Cached binaries are copied out before they are run, so eviction by
+/// another GUI instance never pulls a binary out from under a running test.
+class CompileCache {
+  static const int maxBytes = 512 * 1024 * 1024;
+
+  static final Map<String, String> _compilerIdentities = {};
+
+  static String get cacheDir {
+    final env = Platform.environment;
+    if (Platform.isWindows) {
+      final base = env['LOCALAPPDATA'] ?? Directory.systemTemp.path;
+      return path.join(base, 'cpp-judge', 'gui-binaries');
+    }
+    final xdg = env['XDG_CACHE_HOME'];
+    if (xdg != null && xdg.isNotEmpty) {
+      return path.join(xdg, 'cpp-judge', 'gui-binaries');
+    }
+    final home = env['HOME'];
+    if (home != null && home.isNotEmpty) {
+      return path.join(home, '.cache', 'cpp-judge', 'gui-binaries');
+    }
+    return path.join(Directory.systemTemp.path, 'cpp-judge', 'gui-binaries');
+  }
+
+  /// Version and target of the compiler, computed once per compiler path.
+  static Future<String> _compilerIdentity(String gppPath) async {
+    final cached = _compilerIdentities[gppPath];
+    if (cached != null) return cached;
+
+    var identity = gppPath;
+    try {
+      final result = await Process.run(gppPath, ['-dumpfullversion', '-dumpmachine']);
+      if (result.exitCode == 0) {
+        identity = '$gppPath|${(result.stdout as String).trim()}';
+      }
+    } catch (_) {
+      // Unknown compiler: fall back to its path only.
+    }
+    _compilerIdentities[gppPath] = identity;
+    return identity;
+  }
+
+  static Future<String> key(String gppPath, List<String> flags, String source) async {
+    final identity = await _compilerIdentity(gppPath);
+    final bytes = BytesBuilder(copy: false)
+      ..add(utf8.encode('cpp-judge-cache-v1'))
+      ..addByte(0)
+      ..add(utf8.encode(identity))
+      ..addByte(0);
+    for (final flag in flags) {
+      bytes
+        ..add(utf8.encode(flag))
+        ..addByte(0);
+    }
+    bytes
+      ..addByte(0)
+      ..add(utf8.encode(source));
+    return sha256.convert(bytes.takeBytes()).toString();
+  }
+
+  /// Copies the cached binary for [key] to [destination]. Returns false on a
+  /// miss or if the entry disappeared while copying.
+  static Future<bool> fetch(String key, File destination) async {
+    final entry = File(path.join(cacheDir, key));
+    try {
+      if (!await entry.exists()) return false;
+      await entry.copy(destination.path);
+      await entry.setLastModified(DateTime.now());
+      return true;
+    } catch (_) {
+      return false;
+    }
+  }
+
+  /// Stores a freshly compiled [binary] under [key]. The copy is written to a
+  /// temporary name and renamed into place so readers never see a partial
+  /// file.
+  static Future<void> store(String key, File binary) async {
+    try {
+      final dir = Directory(cacheDir);
+      await dir.create(recursive: true);
+      final staged = File(path.join(
+        dir.path,
+        '.tmp-$pid-${DateTime.now().microsecondsSinceEpoch}',
+      ));
+      await binary.copy(staged.path);
+      await staged.rename(path.join(dir.path, key));
+      await _evict(dir);
+    } catch (e) {
+      print('Warning: could not store binary in compile cache: $e');
+    }
+  }
+
+  static Future<void> _evict(Directory dir) async {
+    final entries = <File, FileStat>{};
+    var total = 0;
+    await for (final entity in dir.list()) {
+      if (entity is! File || path.basename(entity.path).startsWith('.')) continue;
+      final stat = await entity.stat();
+      entries[entity] = stat;
+      total += stat.size;
+    }
+    if (total <= maxBytes) return;
+
+    final byAge = entries.keys.toList()
+      ..sort((a, b) => entries[a]!.modified.compareTo(entries[b]!.modified));
+    for (final file in byAge) {
+      if (total <= maxBytes) break;
+      try {
+        await file.delete();
+        total -= entries[file]!.size;
+      } catch (_) {
+        // In use or already removed by another judge.
+      }
+    }
+  }
+}
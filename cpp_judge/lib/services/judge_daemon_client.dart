@@ -0,0 +1,69 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:io';
+import 'package:path/path.dart' as path;
+
+/// Client for the resident CLI judge server (`judge --serve`, see
+/// judge_server.h). The server keeps problems in memory and compiles and
+/// runs submissions on a persistent worker pool, so judging through it
+/// avoids starting a fresh toolchain pipeline for every click.
+///
+/// Only available where Unix domain sockets are (Linux and macOS).
+class JudgeDaemonClient {
+  static const Duration timeout = Duration(minutes: 2);
+
+  /// Same default as `default_socket_path()` in judge_server.h.
+  static String get socketPath {
+    final env = Platform.environment;
+    final override = env['CPP_JUDGE_SOCKET'];
+    if (override != null && override.isNotEmpty) return override;
+    final runtime = env['XDG_RUNTIME_DIR'];
+    if (runtime != null && runtime.isNotEmpty) {
+      return path.join(runtime, 'cpp-judge.sock');
+    }
+    return '/tmp/cpp-judge-$_uid.sock';
+  }
+
+  static final String _uid = () {
+    try {
+      return (Process.runSync('id', ['-u']).stdout as String).trim();
+    } catch (_) {
+      return '';
+    }
+  }();
+
+  static Future<bool> get available async {
+    if (Platform.isWindows) return false;
+    return FileSystemEntity.typeSync(socketPath) == FileSystemEntityType.unixDomainSock;
+  }
+
+  /// Judges [sourcePath] against [problemId]. Returns the `result` object
+  /// of the server's response, or null if the server is not running, is
+  /// busy or failed; the caller then judges locally.
+  static Future<Map<String, dynamic>?> judge(String sourcePath, int problemId) async {
+    if (!await available) return null;
+    Socket? socket;
+    try {
+      socket = await Socket.connect(
+        InternetAddress(socketPath, type: InternetAddressType.unix),
+        0,
+        timeout: const Duration(seconds: 2),
+      );
+      socket.write('JUDGE $problemId ${File(sourcePath).absolute.path}\n');
+      await socket.flush();
+      final line = await socket
+          .cast<List<int>>()
+          .transform(utf8.decoder)
+          .transform(const LineSplitter())
+          .first
+          .timeout(timeout);
+      final response = jsonDecode(line) as Map<String, dynamic>;
+      if (response['status'] != 'ok') return null;
+      return response['result'] as Map<String, dynamic>?;
+    } catch (_) {
+      return null;
+    } finally {
+      socket?.destroy();
+    }
+  }
+}
@@ -2,6 +2,8 @@ import 'dart:io';
 import 'dart:convert';
 import 'package:path/path.dart' as path;
 import 'package:process_run/shell.dart';
+import 'compile_cache.dart';
+import 'judge_daemon_client.dart';
 import 'problem_loader.dart';
 
 class TestCase {
@@ -114,31 +116,50 @@ class JudgeService {
       // Write source code to file
       await sourceFile.writeAsString(sourceCode);
 
+      // Prefer a running judge server; judge locally if there is none
+      final daemonResult = await JudgeDaemonClient.judge(sourceFile.path, problemId);
+      if (daemonResult != null) {
+        final result = await _fromDaemonResult(daemonResult, problemId);
+        if (result != null) {
+          await tempDir.delete(recursive: true);
+          return result;
+        }
+      }
+
       // Find g++ compiler
       String gppPath = await _findCompiler(tempDir.path);
 
-      // Compile
-      final shell = Shell(workingDirectory: tempDir.path);
-      try {
-        if (Platform.isWindows) {
-          await shell.run(
-            '"$gppPath" solution.cpp -o solution.exe -O2 -static -std=c++17',
-          );
-        } else {
-          await shell.run(
-            'g++ solution.cpp -o solution -O2 -std=c++17',
+      // Compile, unless an identical submission is in the compile cache
+      final flags = Platform.isWindows
+          ? ['-O2', '-static', '-std=c++17']
+          : ['-O2', '-std=c++17'];
+      final cacheKey = await CompileCache.key(gppPath, flags, sourceCode);
+      if (!await CompileCache.fetch(cacheKey, exeFile)) {
+        final shell = Shell(workingDirectory: tempDir.path);
+        try {
+          if (Platform.isWindows) {
+            await shell.run(
+              '"$gppPath" solution.cpp -o solution.exe ${flags.join(' ')}',
+            );
+          } else {
+            await shell.run(
+              'g++ solution.cpp -o solution ${flags.join(' ')}',
+            );
+          }
+        } catch (e) {
+          // Compilation failed
+          await tempDir.delete(recursive: true);
+          return JudgeResult(
+            compilationSuccess: false,
+            compilationError: e.toString(),
+            testResults: [],
+            passedTests: 0,
+            totalTests: 0,
           );
         }
-      } catch (e) {
-        // Compilation failed
-        await tempDir.delete(recursive: true);
-        return JudgeResult(
-          compilationSuccess: false,
-          compilationError: e.toString(),
-          testResults: [],
-          passedTests: 0,
-          totalTests: 0,
-        );
+        if (await exeFile.exists()) {
+          await CompileCache.store(cacheKey, exeFile);
+        }
       }
 
       // Check if exe was created
@@ -221,6 +242,63 @@ class JudgeService {
     }
   }
 
+  static const Map<String, String> _verdictNames = {
+    'TLE': 'Time Limit Exceeded',
+    'MLE': 'Memory Limit Exceeded',
+    'OLE': 'Output Limit Exceeded',
+    'RE': 'Runtime Error',
+  };
+
+  /// Converts a judge server result (report.h, write_submission_json) into
+  /// a [JudgeResult]. Returns null for results the GUI should not trust,
+  /// such as judge errors.
+  static Future<JudgeResult?> _fromDaemonResult(
+    Map<String, dynamic> result,
+    int problemId,
+  ) async {
+    final verdict = result['verdict'] as String?;
+    if (verdict == 'CE') {
+      return JudgeResult(
+        compilationSuccess: false,
+        compilationError: result['message'] as String? ?? 'Compilation failed',
+        testResults: [],
+        passedTests: 0,
+        totalTests: 0,
+      );
+    }
+    final tests = result['tests'] as List<dynamic>?;
+    if (verdict == null || verdict == 'JE' || tests == null) return null;
+
+    // The server only reports verdicts; input and expected output of a
+    // failing test come from the problem files.
+    List<TestCase>? testCases;
+    final List<TestResult> testResults = [];
+    for (final entry in tests.cast<Map<String, dynamic>>()) {
+      final number = entry['test'] as int;
+      final testVerdict = entry['verdict'] as String;
+      if (testVerdict == 'AC') {
+        testResults.add(TestResult(testNumber: number, passed: true));
+        continue;
+      }
+      testCases ??= await ProblemLoader.loadTestCases(problemId);
+      final testCase = number <= testCases.length ? testCases[number - 1] : null;
+      testResults.add(TestResult(
+        testNumber: number,
+        passed: false,
+        input: testCase?.input,
+        expectedOutput: testCase?.expectedOutput,
+        actualOutput: entry['output'] as String?,
+        error: testVerdict == 'WA' ? null : (_verdictNames[testVerdict] ?? testVerdict),
+      ));
+    }
+    return JudgeResult(
+      compilationSuccess: true,
+      testResults: testResults,
+      passedTests: result['passed'] as int,
+      totalTests: result['total'] as int,
+    );
+  }
+
   static String _trimNewlines(String s) {
     return s.replaceAll(RegExp(r'[\r\n]+$'), '');
   }
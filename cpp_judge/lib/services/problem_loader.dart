@@ -27,6 +27,13 @@ class ProblemLoader {
     return path.join(exeDir, '..', 'problems');
   }
   
+  // Written by the judge next to the problem folders (see problem_catalog.h)
+  static const _catalogHeader = 'cpp-judge-catalog 1';
+
+  // Lists the problems with their titles and limits. Problems in
+  // problems/.catalog are taken from there; only folders missing from it
+  // have their info.json read. Statements and examples come from
+  // loadProblem() once a problem is opened.
   static Future<List<Problem>> loadAllProblems() async {
     final problemsPath = _getProblemsPath();
     final problemsDir = Directory(problemsPath);
@@ -56,9 +63,16 @@ class ProblemLoader {
       return idA.compareTo(idB);
     });
     
+    final catalog = await _readCatalog(problemsPath);
+    
     for (final dir in problemDirs) {
+      final listed = catalog[int.parse(path.basename(dir.path))];
+      if (listed != null) {
+        problems.add(listed);
+        continue;
+      }
       try {
-        final problem = await _loadProblem(dir.path);
+        final problem = await _loadProblem(dir.path, withExamples: false);
         if (problem != null) {
           problems.add(problem);
         }
@@ -76,7 +90,50 @@ class ProblemLoader {
     return problems;
   }
   
-  static Future<Problem?> _loadProblem(String problemDir) async {
+  // The full problem: statement from info.json and the first tests as
+  // examples.
+  static Future<Problem?> loadProblem(int problemId) async {
+    try {
+      return await _loadProblem(path.join(_getProblemsPath(), problemId.toString()));
+    } catch (e) {
+      print('Error loading problem $problemId: $e');
+      return null;
+    }
+  }
+  
+  // One line per problem: "<id> <stamps> <test count>", then title, time
+  // limit and memory limit separated by tabs. A missing or unreadable
+  // catalog is the same as an empty one.
+  static Future<Map<int, Problem>> _readCatalog(String problemsPath) async {
+    final Map<int, Problem> problems = {};
+    final catalogFile = File(path.join(problemsPath, '.catalog'));
+    if (!await catalogFile.exists()) return problems;
+    try {
+      final lines = await catalogFile.readAsLines();
+      if (lines.isEmpty || lines.first != _catalogHeader) return problems;
+      for (final line in lines.skip(1)) {
+        final fields = line.split('\t');
+        final id = int.tryParse(fields.first.split(' ').first);
+        if (fields.length != 4 || id == null) return {};
+        problems[id] = Problem(
+          id: id,
+          title: fields[1],
+          timeLimit: fields[2].isEmpty ? '1 second' : fields[2],
+          memoryLimit: fields[3].isEmpty ? '256 megabytes' : fields[3],
+          description: '',
+          inputFormat: '',
+          outputFormat: '',
+          examples: const [],
+        );
+      }
+    } catch (e) {
+      print('Warning: cannot read problem catalog: $e');
+      return {};
+    }
+    return problems;
+  }
+  
+  static Future<Problem?> _loadProblem(String problemDir, {bool withExamples = true}) async {
     final infoFile = File(path.join(problemDir, 'info.json'));
     
     if (!await infoFile.exists()) {
@@ -90,7 +147,7 @@ class ProblemLoader {
     final testsDir = Directory(path.join(problemDir, 'tests'));
     final List<Example> examples = [];
     
-    if (await testsDir.exists()) {
+    if (withExamples && await testsDir.exists()) {
       final testFiles = await testsDir
           .list()
           .where((file) => file.path.endsWith('.json'))
@@ -0,0 +1,460 @@
+#pragma once
+
+// Fork-server mode: the submission is started once per submission instead
+// of once per test. A small harness linked into the binary runs before any
+// of the submission's own code (static initializers included). When the
+// judge started it as a fork server, it waits for requests. For each test
+// it forks a child, which takes the test's stdin/stdout/stderr and
+// limits, and carries on into main() as a freshly executed program would.
+// A test then costs a copy-on-write fork of a process that has barely run,
+// instead of an exec, dynamic setup and C++ runtime startup.
+//
+// The server reports each child's wait status and resource usage back to
+// the judge, so CPU time, peak memory and exit status come from the child
+// exactly as wait4() would report them for a directly started process.
+// A forked child's peak RSS starts at the pages it shares with the
+// server, which are the ones exec and startup would have touched.
+//
+// Protocol (SOCK_SEQPACKET, the server's stdin): once ready, the server
+// sends one message with its pid. Every request carries the child's limits
+// and four descriptors (stdin, stdout, stderr, a reply socket). On the
+// reply socket the server sends one message with the pid (or errno) right
+// after fork() and one with the exit status and usage once the child has
+// been reaped.
+//
+// Submission code that runs before the harness (constructors with a higher
+// priority) runs in the server, under the test's limits. A server that is
+// not ready within the time limit is killed and the tests are executed
+// afresh, as is every test once the server stops answering.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "compile_cache.h"
+#include "process_runner.h"
+#include "sha256.h"
+
+namespace fork_server_detail {
+
+inline constexpr const char* serverEnv = "JUDGE_FORK_SERVER=1";
+
+// Both sides include this layout; the harness below repeats it.
+struct Request {
+    long long cpuTimeMs;
+    long long memoryBytes;
+};
+
+struct Reply {
+    int pid;            // first message: the child, or -1 with `error`
+    int error;
+    int status;         // second message: wait status and usage
+    long long userUs;
+    long long systemUs;
+    long maxRssKb;
+};
+
+// Linked into submissions in fork-server mode. Plain POSIX calls only: it
+// runs before main() and must not depend on anything being initialized.
+inline constexpr const char* harnessSource = R"harness(
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Request { long long cpuTimeMs; long long memoryBytes; };
+struct Reply { int pid; int error; int status; long long userUs; long long systemUs; long maxRssKb; };
+
+void send_reply(int fd, const Reply& reply) {
+    while (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+// In the child: becomes the process the judge would have started.
+void become_test(const int fds[4], const Request& request, const sigset_t& oldMask) {
+    setpgid(0, 0);
+    signal(SIGPIPE, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &oldMask, nullptr);
+    for (int target = 0; target < 3; ++target) {
+        if (dup2(fds[target], target) < 0) _exit(127);
+    }
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) != 0)
+#endif
+        for (int fd = 3; fd < 1024; ++fd) close(fd);
+    if (request.cpuTimeMs > 0) {
+        rlim_t seconds = static_cast<rlim_t>((request.cpuTimeMs + 999) / 1000);
+        rlimit cpu{seconds, seconds + 1};
+        if (setrlimit(RLIMIT_CPU, &cpu) != 0) _exit(127);
+    }
+    if (request.memoryBytes > 0) {
+        rlimit mem{static_cast<rlim_t>(request.memoryBytes), static_cast<rlim_t>(request.memoryBytes)};
+        if (setrlimit(RLIMIT_AS, &mem) != 0 || setrlimit(RLIMIT_STACK, &mem) != 0) _exit(127);
+    }
+    rlimit core{0, 0};
+    setrlimit(RLIMIT_CORE, &core);
+}
+
+void serve() {
+    unsetenv("JUDGE_FORK_SERVER");
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t childMask, oldMask;
+    sigemptyset(&childMask);
+    sigaddset(&childMask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+    int childFd = signalfd(-1, &childMask, SFD_CLOEXEC | SFD_NONBLOCK);
+    send_reply(0, Reply{static_cast<int>(getpid()), 0, 0, 0, 0, 0});
+    struct Running { pid_t pid; int reply; };
+    static Running running[1024];
+    int count = 0;
+    bool open = true;
+    while (open || count > 0) {
+        pollfd fds[2] = {{open ? 0 : -1, POLLIN, 0}, {childFd, POLLIN, 0}};
+        if (poll(fds, 2, childFd < 0 ? 10 : -1) < 0 && errno != EINTR) break;
+        if (fds[1].revents) {
+            signalfd_siginfo info;
+            while (read(childFd, &info, sizeof(info)) > 0) {}
+        }
+        rusage usage;
+        int status;
+        pid_t pid;
+        while (count > 0 && (pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+            for (int i = 0; i < count; ++i) {
+                if (running[i].pid != pid) continue;
+                Reply reply{pid, 0, status,
+                            usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec,
+                            usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec, usage.ru_maxrss};
+                send_reply(running[i].reply, reply);
+                close(running[i].reply);
+                running[i] = running[--count];
+                break;
+            }
+        }
+        if (!open || !(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        Request request;
+        iovec iov{&request, sizeof(request)};
+        alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(0, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+        if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(4 * sizeof(int)) ||
+            n != sizeof(request)) {
+            // The judge went away (or sent garbage): stop everything.
+            for (int i = 0; i < count; ++i) kill(-running[i].pid, SIGKILL);
+            open = false;
+            continue;
+        }
+        int passed[4];
+        std::memcpy(passed, CMSG_DATA(cmsg), sizeof(passed));
+        pid = count < 1024 ? fork() : -1;
+        if (pid == 0) {
+            if (childFd >= 0) close(childFd);
+            become_test(passed, request, oldMask);
+            return;
+        }
+        int error = pid < 0 ? (count < 1024 ? errno : EAGAIN) : 0;
+        if (pid > 0) {
+            setpgid(pid, pid);
+            running[count++] = {pid, passed[3]};
+        }
+        send_reply(passed[3], Reply{pid, error, 0, 0, 0, 0});
+        if (pid < 0) close(passed[3]);
+        for (int i = 0; i < 3; ++i) close(passed[i]);
+    }
+    _exit(0);
+}
+
+__attribute__((constructor(101))) void judge_fork_server() {
+    const char* mode = getenv("JUDGE_FORK_SERVER");
+    if (mode && mode[0] == '1') serve();
+}
+
+} // namespace
+)harness";
+
+} // namespace fork_server_detail
+
+// Compiles the harness once per compiler and flags into `dir` and returns
+// the object file to link submissions with, or "" with `error` set.
+inline std::string build_fork_server_harness(const std::string& compiler, const std::vector<std::string>& flags,
+                                             const std::filesystem::path& dir, std::string& error) {
+    std::string key = fork_server_detail::harnessSource;
+    for (const auto& flag : flags) key += "\n" + flag;
+    key += "\n" + compiler_identity(compiler);
+    std::filesystem::path object = dir / ("fork_server_" + sha256_hex(key).substr(0, 16) + ".o");
+    std::error_code ec;
+    if (std::filesystem::exists(object, ec)) return object.string();
+
+    std::filesystem::create_directories(dir, ec);
+    // Unique per call: several threads may build the harness at once.
+    static std::atomic<unsigned> counter{0};
+    std::string stem =
+        (dir / ("fork_server." + std::to_string(getpid()) + "-" + std::to_string(counter++))).string();
+    std::string source = stem + ".cpp", staging = stem + ".o";
+    {
+        std::ofstream out(source, std::ios::binary);
+        out << fork_server_detail::harnessSource;
+        if (!out) {
+            error = "cannot write " + source;
+            return "";
+        }
+    }
+    RunOptions compile;
+    compile.argv = {compiler, "-c", source, "-o", staging};
+    compile.argv.insert(compile.argv.end(), flags.begin(), flags.end());
+    RunResult result = run_process(compile);
+    std::filesystem::remove(source, ec);
+    if (!result.started || result.exitCode != 0) {
+        error = "cannot compile the fork-server harness: " + (result.started ? result.err : result.error);
+        std::filesystem::remove(staging, ec);
+        return "";
+    }
+    std::filesystem::rename(staging, object, ec);
+    if (ec) {
+        error = "cannot store the fork-server harness: " + ec.message();
+        std::filesystem::remove(staging, ec);
+        return "";
+    }
+    return object.string();
+}
+
+// Judge side of one running fork server. Safe to use from several threads;
+// each test gets its own reply socket.
+class ForkServer : public ProcessLauncher {
+public:
+    // Starts `exePath` (linked with the harness) as a fork server under the
+    // CPU and memory limits of a test, and waits for it to be ready for at
+    // most the test's wall time limit (or replyTimeoutMs).
+    static std::unique_ptr<ForkServer> start(const std::string& exePath, const ResourceLimits& limits,
+                                             std::string& error) {
+        int control[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, control) != 0) {
+            error = std::string("socketpair: ") + std::strerror(errno);
+            return nullptr;
+        }
+        SpawnOptions spawn;
+        spawn.argv = {exePath};
+        spawn.env = {fork_server_detail::serverEnv};
+        spawn.stdinFd = control[1];
+        spawn.limits.cpuTimeMs = limits.cpuTimeMs;
+        spawn.limits.memoryBytes = limits.memoryBytes;
+        SpawnedProcess server = spawn_process(spawn);
+        close(control[1]);
+        if (server.pid < 0) {
+            close(control[0]);
+            error = server.error;
+            return nullptr;
+        }
+        std::unique_ptr<ForkServer> forkServer(new ForkServer(server.pid, control[0]));
+        fork_server_detail::Reply ready{};
+        if (!forkServer->receive(control[0], ready, limits.wallTimeMs > 0 ? limits.wallTimeMs : replyTimeoutMs,
+                                 nullptr) ||
+            ready.pid != server.pid) {
+            error = "the submission did not reach the fork server in time";
+            return nullptr;
+        }
+        return forkServer;
+    }
+
+    ForkServer(const ForkServer&) = delete;
+    ForkServer& operator=(const ForkServer&) = delete;
+
+    // Closing the control socket makes a healthy server kill what is left
+    // and exit; one that is stuck is killed.
+    ~ForkServer() override {
+        process_detail::close_fd(control_);
+        kill(-pid_, SIGKILL);
+        int status;
+        while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {}
+        for (auto& [pid, fd] : replies_) close(fd);
+    }
+
+    SpawnedProcess spawn(const SpawnOptions& options) const override {
+        SpawnedProcess spawned;
+        if (!options.workingDir.empty() || !options.env.empty() || options.argv.size() != 1) {
+            spawned.error = "fork server: only the plain submission can be started";
+            return spawned;
+        }
+        if (failed_) return spawnDirect(options);
+        int reply[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, reply) != 0) {
+            spawned.error = std::string("socketpair: ") + std::strerror(errno);
+            return spawned;
+        }
+        int nullFd = -1;
+        int fds[4] = {options.stdinFd, options.stdoutFd, options.stderrFd, reply[1]};
+        for (int i = 0; i < 3; ++i) {
+            if (fds[i] >= 0) continue;
+            if (nullFd < 0) nullFd = open("/dev/null", O_RDWR | O_CLOEXEC);
+            fds[i] = nullFd;
+        }
+        fork_server_detail::Request request{options.limits.cpuTimeMs, options.limits.memoryBytes};
+        iovec iov{&request, sizeof(request)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        ssize_t sent;
+        while ((sent = sendmsg(control_, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+        int sendErrno = errno;
+        process_detail::close_fd(nullFd);
+        close(reply[1]);
+
+        fork_server_detail::Reply first{};
+        const long waitMs = options.limits.wallTimeMs > 0 ? options.limits.wallTimeMs : replyTimeoutMs;
+        if (sent != sizeof(request) || !receive(reply[0], first, waitMs, options.cancel)) {
+            close(reply[0]);
+            if (options.cancel && options.cancel->load()) {
+                spawned.error = "fork server: cancelled";
+                return spawned;
+            }
+            // Dead or stuck: this and every later test is executed afresh.
+            if (!failed_.exchange(true)) {
+                std::cerr << "Warning: the fork server stopped answering"
+                          << (sent != sizeof(request) ? std::string(": ") + std::strerror(sendErrno) : "")
+                          << ", running tests without it\n";
+                kill(-pid_, SIGKILL);
+            }
+            return spawnDirect(options);
+        }
+        if (first.pid <= 0) {
+            close(reply[0]);
+            spawned.error = std::string("fork server: ") + std::strerror(first.error);
+            return spawned;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        replies_[first.pid] = reply[0];
+        spawned.pid = first.pid;
+        return spawned;
+    }
+
+    int exitFd(pid_t pid) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (direct_.count(pid)) return process_detail::open_pidfd(pid);
+        auto it = replies_.find(pid);
+        return it == replies_.end() ? -1 : fcntl(it->second, F_DUPFD_CLOEXEC, 0);
+    }
+
+    pid_t wait(pid_t pid, int* status, int flags, rusage* usage) const override {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (direct_.count(pid)) {
+                pid_t reaped;
+                while ((reaped = wait4(pid, status, flags, usage)) < 0 && errno == EINTR) {}
+                if (reaped == pid) direct_.erase(pid);
+                return reaped;
+            }
+            auto it = replies_.find(pid);
+            if (it == replies_.end()) {
+                errno = ECHILD;
+                return -1;
+            }
+            fd = it->second;
+        }
+        if (flags & WNOHANG) {
+            pollfd ready{fd, POLLIN, 0};
+            if (poll(&ready, 1, 0) <= 0) return 0;
+        }
+        fork_server_detail::Reply reply{};
+        // The child is gone or killed by now, so the server answers at once
+        // unless it is stuck.
+        bool got = receive(fd, reply, replyTimeoutMs, nullptr);
+        *usage = rusage{};
+        if (got) {
+            *status = reply.status;
+            usage->ru_utime = {static_cast<time_t>(reply.userUs / 1000000), static_cast<suseconds_t>(reply.userUs % 1000000)};
+            usage->ru_stime = {static_cast<time_t>(reply.systemUs / 1000000), static_cast<suseconds_t>(reply.systemUs % 1000000)};
+            usage->ru_maxrss = reply.maxRssKb;
+        } else {
+            // The server died. Report the child as killed; run_process()
+            // kills its process group after wait() in any case.
+            *status = SIGKILL;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        replies_.erase(pid);
+        close(fd);
+        return pid;
+    }
+
+private:
+    // How long to wait for the server when no time limit applies.
+    static constexpr long replyTimeoutMs = 10000;
+
+    ForkServer(pid_t pid, int control) : pid_(pid), control_(control) {}
+
+    // Receives one message within `timeoutMs`, giving up early once
+    // `cancel` is set. False on timeout, cancellation, EOF and errors.
+    static bool receive(int fd, fork_server_detail::Reply& reply, long timeoutMs, const std::atomic<bool>* cancel) {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (true) {
+            if (cancel && cancel->load()) return false;
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (left <= 0) return false;
+            pollfd ready{fd, POLLIN, 0};
+            int n = poll(&ready, 1, static_cast<int>(cancel ? std::min<long long>(left, 10) : left));
+            if (n < 0 && errno != EINTR) return false;
+            if (n <= 0) continue;
+            ssize_t got;
+            while ((got = recv(fd, &reply, sizeof(reply), 0)) < 0 && errno == EINTR) {}
+            return got == sizeof(reply);
+        }
+    }
+
+    // Executes the submission like spawn_process() once the server failed.
+    SpawnedProcess spawnDirect(const SpawnOptions& options) const {
+        SpawnedProcess spawned = spawn_process(options);
+        if (spawned.pid > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            direct_.insert(spawned.pid);
+        }
+        return spawned;
+    }
+
+    pid_t pid_;
+    int control_;
+    mutable std::atomic<bool> failed_{false};  // tests are executed afresh
+    mutable std::mutex mutex_;
+    mutable std::map<pid_t, int> replies_;   // running test -> reply socket
+    mutable std::set<pid_t> direct_;         // tests started without the server
+};
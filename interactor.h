@@ -0,0 +1,396 @@
+#pragma once
+
+// Interactive problems: the submission talks to a per-problem interactor
+// instead of reading a fixed input. The judge sits between the two and
+// relays every message itself, so it can keep a transcript and tell which
+// side stopped talking:
+//
+//   submission stdout --> judge --> interactor stdin
+//   submission stdin  <-- judge <-- interactor stdout
+//
+// The relay is a single epoll loop over plain pipes. Data read from one
+// side is written to the other right away, without waiting for the next
+// poll round, so a round trip costs a few syscalls and no buffering layer.
+// Each direction buffers at most one read (64 KB) and only reads again once
+// that has been delivered, which keeps memory bounded however much the two
+// programs exchange.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "process_runner.h"
+
+struct InteractionOptions {
+    std::vector<std::string> solution;    // submission command line
+    std::vector<std::string> interactor;  // interactor command line
+    ResourceLimits solutionLimits;
+    ResourceLimits interactorLimits;
+    const std::atomic<bool>* cancel = nullptr;
+    size_t transcriptBytes = 64 * 1024;   // transcript kept; the rest is counted only
+};
+
+struct InteractionResult {
+    RunResult solution;                   // `out` holds the transcript
+    RunResult interactor;                 // exit code, usage and stderr
+    long long transcriptBytes = 0;        // bytes exchanged in both directions
+};
+
+namespace interaction_detail {
+
+struct Child {
+    pid_t pid = -1;
+    int pidFd = -1;
+    bool exited = false;
+    int status = 0;
+    rusage usage{};
+    std::chrono::steady_clock::time_point start;
+    RunResult* result = nullptr;
+
+    void reap(int flags) {
+        if (pid < 0 || exited) return;
+        pid_t r;
+        while ((r = wait4(pid, &status, flags, &usage)) < 0 && errno == EINTR) {}
+        if (r != pid) return;
+        exited = true;
+        result->wallTimeMs = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                   std::chrono::steady_clock::now() - start).count());
+        kill(-pid, SIGKILL);
+        process_detail::close_fd(pidFd);
+    }
+
+    void kill_group() {
+        if (pid >= 0 && !exited) kill(-pid, SIGKILL);
+    }
+
+    void finish() {
+        reap(0);
+        process_detail::close_fd(pidFd);
+        if (WIFEXITED(status)) {
+            result->exitCode = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            result->termSignal = WTERMSIG(status);
+        }
+        result->cpuTimeMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000L +
+                            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000L;
+        result->peakMemoryKb = usage.ru_maxrss;
+    }
+};
+
+// One direction of the relay: reads from `from`, writes to `to`.
+struct Channel {
+    int from = -1;
+    int to = -1;
+    std::string pending;       // read but not yet delivered
+    size_t offset = 0;
+    const char* marker;        // transcript prefix for this direction
+
+    bool idle() const { return offset == pending.size(); }
+
+    // Writes freshly read data straight through; only what the pipe does
+    // not take right away is copied into `pending`.
+    void forward(std::string_view data) {
+        while (to >= 0 && !data.empty()) {
+            ssize_t w = write(to, data.data(), data.size());
+            if (w > 0) {
+                data.remove_prefix(static_cast<size_t>(w));
+            } else if (w < 0 && errno == EINTR) {
+                continue;
+            } else {
+                if (w < 0 && errno == EAGAIN) pending.assign(data);
+                if (w < 0 && errno != EAGAIN) process_detail::close_fd(to);
+                return;
+            }
+        }
+    }
+
+    // Delivers as much of `pending` as the pipe takes without blocking.
+    void flush() {
+        while (to >= 0 && !idle()) {
+            ssize_t w = write(to, pending.data() + offset, pending.size() - offset);
+            if (w > 0) {
+                offset += static_cast<size_t>(w);
+            } else if (w < 0 && errno == EINTR) {
+                continue;
+            } else {
+                // EAGAIN: wait for POLLOUT. Anything else: the reader is
+                // gone, so whatever is left can never be delivered.
+                if (w < 0 && errno != EAGAIN) {
+                    process_detail::close_fd(to);
+                    pending.clear();
+                    offset = 0;
+                }
+                return;
+            }
+        }
+        if (idle()) {
+            pending.clear();
+            offset = 0;
+            if (from < 0) process_detail::close_fd(to);  // pass the EOF on
+        }
+    }
+};
+
+// Both directions of the conversation, each line prefixed with who sent
+// it, up to `limit` bytes.
+struct Transcript {
+    std::string& text;
+    size_t limit;
+    long long bytes = 0;
+    const char* last = nullptr;
+
+    void append(const char* marker, std::string_view data) {
+        bytes += static_cast<long long>(data.size());
+        if (marker != last && !text.empty() && text.back() != '\n' && text.size() < limit) text += '\n';
+        last = marker;
+        while (!data.empty() && text.size() < limit) {
+            if (text.empty() || text.back() == '\n') text += marker;
+            size_t line = data.find('\n');
+            line = line == std::string_view::npos ? data.size() : line + 1;
+            line = std::min(line, limit - std::min(limit, text.size()));
+            if (line == 0) break;
+            text.append(data.substr(0, line));
+            data.remove_prefix(line);
+        }
+    }
+};
+
+} // namespace interaction_detail
+
+// Runs the submission against the interactor until both have exited. The
+// submission's wall-clock limit bounds the whole interaction; the
+// interactor is killed too once it has passed.
+inline InteractionResult run_interaction(const InteractionOptions& options) {
+    using interaction_detail::Channel;
+    using interaction_detail::Child;
+    using process_detail::close_fd;
+    using Clock = std::chrono::steady_clock;
+
+    InteractionResult result;
+    int solIn[2] = {-1, -1}, solOut[2] = {-1, -1}, solErr[2] = {-1, -1};
+    int intIn[2] = {-1, -1}, intOut[2] = {-1, -1}, intErr[2] = {-1, -1};
+    auto closeAll = [&] {
+        for (int* p : {solIn, solOut, solErr, intIn, intOut, intErr}) {
+            close_fd(p[0]);
+            close_fd(p[1]);
+        }
+    };
+    for (int* p : {solIn, solOut, solErr, intIn, intOut, intErr}) {
+        if (!process_detail::make_pipe(p)) {
+            result.solution.error = std::string("pipe: ") + std::strerror(errno);
+            closeAll();
+            return result;
+        }
+    }
+
+    const Clock::time_point startTime = Clock::now();
+    Child solution, interactor;
+    solution.result = &result.solution;
+    interactor.result = &result.interactor;
+
+    SpawnOptions spawn;
+    spawn.argv = options.interactor;
+    spawn.limits = options.interactorLimits;
+    spawn.stdinFd = intIn[0];
+    spawn.stdoutFd = intOut[1];
+    spawn.stderrFd = intErr[1];
+    SpawnedProcess started = spawn_process(spawn);
+    if (started.pid < 0) {
+        result.interactor.error = started.error;
+        closeAll();
+        return result;
+    }
+    interactor.pid = started.pid;
+    interactor.start = startTime;
+    result.interactor.started = true;
+
+    spawn.argv = options.solution;
+    spawn.limits = options.solutionLimits;
+    spawn.stdinFd = solIn[0];
+    spawn.stdoutFd = solOut[1];
+    spawn.stderrFd = solErr[1];
+    started = spawn_process(spawn);
+    if (started.pid < 0) {
+        result.solution.error = started.error;
+        closeAll();
+        interactor.kill_group();
+        interactor.finish();
+        return result;
+    }
+    solution.pid = started.pid;
+    solution.start = Clock::now();
+    result.solution.started = true;
+
+    for (int* end : {&solIn[0], &solOut[1], &solErr[1], &intIn[0], &intOut[1], &intErr[1]}) close_fd(*end);
+    for (int fd : {solIn[1], intIn[1], solOut[0], intOut[0]}) fcntl(fd, F_SETFL, O_NONBLOCK);
+    solution.pidFd = process_detail::open_pidfd(solution.pid);
+    interactor.pidFd = process_detail::open_pidfd(interactor.pid);
+
+    Channel toInteractor{solOut[0], intIn[1], {}, 0, "> "};
+    Channel toSolution{intOut[0], solIn[1], {}, 0, "< "};
+    solOut[0] = intIn[1] = intOut[0] = solIn[1] = -1;  // owned by the channels now
+    int errFds[2] = {solErr[0], intErr[0]};
+    std::string* errSinks[2] = {&result.solution.err, &result.interactor.err};
+    solErr[0] = intErr[0] = -1;
+
+    interaction_detail::Transcript transcript{result.solution.out, options.transcriptBytes};
+    const long wallMs = options.solutionLimits.wallTimeMs;
+    const Clock::time_point deadline = startTime + std::chrono::milliseconds(wallMs);
+    // The interactor's own wall limit also holds after the solution is gone.
+    const long interactorWallMs = options.interactorLimits.wallTimeMs;
+    const Clock::time_point interactorDeadline = startTime + std::chrono::milliseconds(interactorWallMs);
+    bool timedOut = false, interactorTimedOut = false;
+    auto killBoth = [&] {
+        solution.kill_group();
+        interactor.kill_group();
+    };
+
+    // Registered once; a source is only dropped from the set while its data
+    // waits for the other side, and a target is only added for that time.
+    // Tags: 0/1 channel sources, 2/3 channel targets, 4/5 stderr, 6/7 pidfds.
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        result.solution.error = std::string("epoll_create1: ") + std::strerror(errno);
+        for (Channel* ch : {&toInteractor, &toSolution}) {
+            close_fd(ch->from);
+            close_fd(ch->to);
+        }
+        close_fd(errFds[0]);
+        close_fd(errFds[1]);
+        killBoth();
+        solution.finish();
+        interactor.finish();
+        return result;
+    }
+    auto watch = [&](int op, int fd, uint32_t events, uint32_t tag) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = tag;
+        epoll_ctl(epollFd, op, fd, &ev);
+    };
+    Channel* channels[2] = {&toInteractor, &toSolution};
+    bool sourceWatched[2] = {true, true}, targetWatched[2] = {false, false};
+    for (uint32_t c = 0; c < 2; ++c) {
+        watch(EPOLL_CTL_ADD, channels[c]->from, EPOLLIN, c);
+        watch(EPOLL_CTL_ADD, errFds[c], EPOLLIN, 4 + c);
+    }
+    if (solution.pidFd >= 0) watch(EPOLL_CTL_ADD, solution.pidFd, EPOLLIN, 6);
+    if (interactor.pidFd >= 0) watch(EPOLL_CTL_ADD, interactor.pidFd, EPOLLIN, 7);
+    // Closed descriptors leave the epoll set by themselves.
+    auto sync = [&](uint32_t c) {
+        Channel& ch = *channels[c];
+        bool wantSource = ch.from >= 0 && ch.idle();
+        bool wantTarget = ch.to >= 0 && !ch.idle();
+        if (ch.from < 0) {
+            sourceWatched[c] = false;
+        } else if (wantSource != sourceWatched[c]) {
+            watch(wantSource ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, ch.from, EPOLLIN, c);
+            sourceWatched[c] = wantSource;
+        }
+        if (ch.to < 0) {
+            targetWatched[c] = false;
+        } else if (wantTarget != targetWatched[c]) {
+            watch(wantTarget ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, ch.to, EPOLLOUT, 2 + c);
+            targetWatched[c] = wantTarget;
+        }
+    };
+
+    char buf[65536];
+    epoll_event events[8];
+    while (!solution.exited || !interactor.exited || toInteractor.from >= 0 || toSolution.from >= 0 ||
+           errFds[0] >= 0 || errFds[1] >= 0) {
+        if (options.cancel && !result.solution.cancelled && options.cancel->load()) {
+            result.solution.cancelled = true;
+            killBoth();
+        }
+        if (wallMs > 0 && !timedOut && Clock::now() >= deadline) {
+            timedOut = true;
+            result.solution.wallTimeExceeded = !solution.exited;
+            result.interactor.wallTimeExceeded = !interactor.exited;
+            killBoth();
+        }
+        if (interactorWallMs > 0 && !interactorTimedOut && Clock::now() >= interactorDeadline) {
+            interactorTimedOut = true;
+            result.interactor.wallTimeExceeded = !interactor.exited;
+            killBoth();
+        }
+
+        int timeout = -1;
+        if (options.cancel || (!solution.exited && solution.pidFd < 0) ||
+            (!interactor.exited && interactor.pidFd < 0)) {
+            timeout = 10;
+        }
+        if (wallMs > 0 && !timedOut) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            left = left < 0 ? 0 : left + 1;
+            if (timeout < 0 || left < timeout) timeout = static_cast<int>(left);
+        }
+        if (interactorWallMs > 0 && !interactorTimedOut) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(interactorDeadline - Clock::now()).count();
+            left = left < 0 ? 0 : left + 1;
+            if (timeout < 0 || left < timeout) timeout = static_cast<int>(left);
+        }
+
+        int ready = epoll_wait(epollFd, events, 8, timeout);
+        if (ready < 0 && errno != EINTR) break;
+        if (solution.pidFd < 0) solution.reap(WNOHANG);
+        if (interactor.pidFd < 0) interactor.reap(WNOHANG);
+
+        for (int e = 0; e < ready; ++e) {
+            const uint32_t tag = events[e].data.u32;
+            if (tag >= 6) {
+                (tag == 6 ? solution : interactor).reap(WNOHANG);
+            } else if (tag >= 4) {
+                int& fd = errFds[tag - 4];
+                if (fd < 0) continue;
+                ssize_t r = read(fd, buf, sizeof(buf));
+                if (r > 0) {
+                    std::string& sink = *errSinks[tag - 4];
+                    if (sink.size() < options.transcriptBytes) {
+                        sink.append(buf, std::min(static_cast<size_t>(r), options.transcriptBytes - sink.size()));
+                    }
+                } else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    close_fd(fd);
+                }
+            } else if (tag >= 2) {
+                channels[tag - 2]->flush();
+                sync(tag - 2);
+            } else {
+                Channel& ch = *channels[tag];
+                if (ch.from < 0 || !ch.idle()) continue;
+                ssize_t r = read(ch.from, buf, sizeof(buf));
+                if (r > 0) {
+                    std::string_view data(buf, static_cast<size_t>(r));
+                    transcript.append(ch.marker, data);
+                    ch.forward(data);
+                } else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    close_fd(ch.from);
+                    ch.flush();
+                }
+                sync(tag);
+            }
+        }
+    }
+    close_fd(epollFd);
+    for (Channel* ch : channels) {
+        close_fd(ch->from);
+        close_fd(ch->to);
+    }
+    close_fd(errFds[0]);
+    close_fd(errFds[1]);
+    killBoth();
+    solution.finish();
+    interactor.finish();
+    result.transcriptBytes = transcript.bytes;
+    result.solution.outputBytes = transcript.bytes;
+    return result;
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+// Single-pass JSON reader for problem files. The caller walks the document
+// with beginObject()/nextKey()/readString()/... and decodes values straight
+// into its own fields; nothing is materialized as a tree. Strings are
+// appended to the destination in unescaped runs, so a multi-megabyte test
+// input costs one scan and a few large copies.
+//
+// Errors are sticky: after the first one every call returns false and
+// error() describes it with a line and column.
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : text_(text) {}
+
+    enum class Type { String, Number, Object, Array, Literal, None };
+
+    bool ok() const { return error_.empty(); }
+
+    const std::string& error() const { return error_; }
+
+    // Expects '{'. Then call nextKey() until it returns false.
+    bool beginObject() {
+        first_ = true;
+        return expect('{');
+    }
+
+    // Reads the next key of the current object and the ':' after it.
+    // Returns false at the closing '}' (consumed) or on error.
+    bool nextKey(std::string& key) {
+        if (!ok()) return false;
+        skipWhitespace();
+        if (peek() == '}') {
+            ++pos_;
+            first_ = false;
+            return false;
+        }
+        if (!first_ && !expect(',')) return false;
+        first_ = false;
+        key.clear();
+        return readString(key) && expect(':');
+    }
+
+    // Appends the decoded string value to `out`.
+    bool readString(std::string& out) {
+        first_ = false;
+        if (!expect('"')) return false;
+        while (true) {
+            // Copy everything up to the next quote, backslash or control
+            // character in one go.
+            size_t runEnd = pos_;
+            while (runEnd < text_.size()) {
+                unsigned char c = static_cast<unsigned char>(text_[runEnd]);
+                if (c == '"' || c == '\\' || c < 0x20) break;
+                ++runEnd;
+            }
+            out.append(text_.data() + pos_, runEnd - pos_);
+            pos_ = runEnd;
+            if (pos_ >= text_.size()) return fail("unterminated string");
+
+            char c = text_[pos_++];
+            if (c == '"') return true;
+            if (c != '\\') return fail("control character in string");
+            if (pos_ >= text_.size()) return fail("unterminated string");
+            switch (text_[pos_++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                    if (!readUnicodeEscape(out)) return false;
+                    break;
+                default:
+                    --pos_;
+                    return fail("invalid escape sequence");
+            }
+        }
+    }
+
+    bool readInt(long long& value) {
+        first_ = false;
+        skipWhitespace();
+        bool negative = peek() == '-';
+        if (negative) ++pos_;
+        size_t start = pos_;
+        unsigned long long magnitude = 0;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+            if (magnitude > (UINT64_MAX - 9) / 10) return fail("integer out of range");
+            magnitude = magnitude * 10 + static_cast<unsigned>(text_[pos_] - '0');
+            ++pos_;
+        }
+        if (pos_ == start) return fail("expected an integer");
+        if (peek() == '.' || peek() == 'e' || peek() == 'E') return fail("expected an integer");
+        if (magnitude > static_cast<unsigned long long>(INT64_MAX) + (negative ? 1 : 0)) {
+            return fail("integer out of range");
+        }
+        value = negative ? static_cast<long long>(0ULL - magnitude) : static_cast<long long>(magnitude);
+        return true;
+    }
+
+    bool readNumber(double& value) {
+        first_ = false;
+        skipWhitespace();
+        size_t start = pos_;
+        while (pos_ < text_.size() && text_[pos_] != '\0' && std::strchr("+-0123456789.eE", text_[pos_]) != nullptr) {
+            ++pos_;
+        }
+        auto [ptr, ec] = std::from_chars(text_.data() + start, text_.data() + pos_, value);
+        if (ec != std::errc() || ptr != text_.data() + pos_) {
+            pos_ = start;
+            return fail("expected a number");
+        }
+        return true;
+    }
+
+    // The type of the next value, told by its first character and not
+    // consumed: callers can skip a value of the wrong type with skipValue()
+    // instead of failing the whole document. Literal is true, false or null.
+    Type peekType() {
+        if (!ok()) return Type::None;
+        skipWhitespace();
+        char c = peek();
+        if (c == '"') return Type::String;
+        if (c == '-' || (c >= '0' && c <= '9')) return Type::Number;
+        if (c == '{') return Type::Object;
+        if (c == '[') return Type::Array;
+        if (c == 't' || c == 'f' || c == 'n') return Type::Literal;
+        return Type::None;
+    }
+
+    // Skips a value of any type, including nested objects and arrays.
+    bool skipValue() {
+        first_ = false;
+        skipWhitespace();
+        char c = peek();
+        if (c == '"') {
+            ++pos_;
+            while (pos_ < text_.size() && text_[pos_] != '"') pos_ += text_[pos_] == '\\' ? 2 : 1;
+            if (pos_ >= text_.size()) return fail("unterminated string");
+            ++pos_;
+            return true;
+        }
+        if (c == '{' || c == '[') {
+            ++pos_;
+            size_t depth = 1;
+            while (depth > 0 && pos_ < text_.size()) {
+                char d = text_[pos_++];
+                if (d == '"') {
+                    while (pos_ < text_.size() && text_[pos_] != '"') pos_ += text_[pos_] == '\\' ? 2 : 1;
+                    ++pos_;
+                } else if (d == '{' || d == '[') {
+                    ++depth;
+                } else if (d == '}' || d == ']') {
+                    --depth;
+                }
+            }
+            return depth == 0 ? true : fail("unterminated object or array");
+        }
+        size_t start = pos_;
+        while (pos_ < text_.size() && std::strchr(",}] \t\r\n", text_[pos_]) == nullptr) ++pos_;
+        return pos_ > start ? true : fail("expected a value");
+    }
+
+    // Succeeds if only whitespace is left.
+    bool end() {
+        skipWhitespace();
+        return pos_ == text_.size() || fail("unexpected data after the document");
+    }
+
+private:
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    void skipWhitespace() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\n' || text_[pos_] == '\r' || text_[pos_] == '\t')) {
+            ++pos_;
+        }
+    }
+
+    bool expect(char c) {
+        if (!ok()) return false;
+        skipWhitespace();
+        if (peek() != c) return fail(std::string("expected '") + c + "'");
+        ++pos_;
+        return true;
+    }
+
+    bool fail(const std::string& message) {
+        if (!ok()) return false;
+        size_t line = 1, column = 1;
+        for (size_t i = 0; i < pos_ && i < text_.size(); ++i) {
+            if (text_[i] == '\n') {
+                ++line;
+                column = 1;
+            } else {
+                ++column;
+            }
+        }
+        error_ = message + " at line " + std::to_string(line) + ", column " + std::to_string(column);
+        return false;
+    }
+
+    bool readHex4(uint32_t& code) {
+        if (text_.size() - pos_ < 4) return fail("truncated \\u escape");
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= static_cast<uint32_t>(c - 'A' + 10);
+            else return fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    // \uXXXX, possibly a surrogate pair, written out as UTF-8.
+    bool readUnicodeEscape(std::string& out) {
+        uint32_t code = 0;
+        if (!readHex4(code)) return false;
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            uint32_t low = 0;
+            if (text_.substr(pos_, 2) != "\\u") return fail("unpaired surrogate in \\u escape");
+            pos_ += 2;
+            if (!readHex4(low)) return false;
+            if (low < 0xDC00 || low > 0xDFFF) return fail("unpaired surrogate in \\u escape");
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+            return fail("unpaired surrogate in \\u escape");
+        }
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        return true;
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    bool first_ = true;   // no ',' expected before the next key
+    std::string error_;
+};
@@ -0,0 +1,644 @@
+#pragma once
+
+// Judging building blocks shared by the interactive CLI and batch mode:
+// compiling a submission (through the compile cache and precompiled
+// headers) and running it on a single test case.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checker.h"
+#include "comparator.h"
+#include "compile_cache.h"
+#include "fork_server.h"
+#include "interactor.h"
+#include "mapped_file.h"
+#include "pch.h"
+#include "problem_pack.h"
+#include "problems.h"
+#include "process_runner.h"
+#include "report.h"
+#include "test_executor.h"
+#include "test_history.h"
+#include "test_stream.h"
+#include "trace.h"
+
+inline std::string getGPPPath() {
+    // Prefer a toolchain bundled next to the judge, fall back to g++ on PATH
+    std::filesystem::path gppFullPath = getJudgeDir() / "mingw64" / "bin" / "g++";
+    if (std::filesystem::exists(gppFullPath)) return gppFullPath.string();
+    return "g++";
+}
+
+struct JudgeOptions {
+    unsigned jobs = default_worker_count();  // test cases run in parallel
+    bool useCache = true;                    // reuse binaries of identical sources
+    std::filesystem::path cacheDir = default_compile_cache_dir();
+    uint64_t cacheMaxBytes = 512ULL << 20;
+    bool usePch = true;                      // precompile common include blocks
+    std::filesystem::path pchDir = default_pch_dir();
+    size_t pchMaxEntries = 8;                // a bits/stdc++.h PCH is ~100 MB
+    bool forkServer = false;                 // start submissions once, fork them per test
+    bool useHistory = true;                  // run tests that often fail first
+    std::filesystem::path historyDir = default_history_dir();
+    std::string tracePath;                   // Chrome trace of the judging phases, empty = no tracing
+    std::filesystem::path problemsDir;       // empty = problems/ next to the judge
+};
+
+inline std::filesystem::path problemsDir(const JudgeOptions& options) {
+    return options.problemsDir.empty() ? std::filesystem::path(getProblemsPath()) : options.problemsDir;
+}
+
+// Limits applied to every run of a submission. The wall-clock watchdog is
+// generous so that a busy machine does not turn slow runs into TLEs; CPU
+// time is what the verdict is based on.
+inline ResourceLimits problemLimits(const ProblemInfo& info) {
+    ResourceLimits limits;
+    limits.cpuTimeMs = info.timeLimitMs;
+    limits.wallTimeMs = info.timeLimitMs * 2 + 1000;
+    limits.memoryBytes = info.memoryLimitBytes;
+    limits.outputBytes = info.outputLimitBytes;
+    return limits;
+}
+
+inline std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \r\n\t");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \r\n\t");
+    return s.substr(first, (last - first + 1));
+}
+
+// Flags every submission is compiled with; part of the compile cache key.
+inline const std::vector<std::string> compileFlags = {"-O2", "-static", "-std=c++17"};
+
+struct CompiledSubmission {
+    bool success = false;
+    bool fromCache = false;                // compile skipped, binary reused
+    std::string exePath;
+    RunResult compiler;                    // not started on a cache hit
+    long compileMs = 0;
+    std::string pchUsed;                   // include block served from a PCH
+    bool pchBuilt = false;                 // the PCH was built for this compile
+    long pchSavedMs = 0;                   // estimated header parsing time saved
+    std::optional<CacheLease> cacheLease;  // keeps a cached binary from being evicted
+    bool ownsExe = false;                  // exePath is a private build to delete afterwards
+    bool forkServer = false;               // linked with the fork-server harness
+
+    CompiledSubmission() = default;
+    CompiledSubmission(CompiledSubmission&&) = default;
+    CompiledSubmission& operator=(CompiledSubmission&&) = default;
+    ~CompiledSubmission() {
+        std::error_code ec;
+        if (ownsExe) std::filesystem::remove(exePath, ec);
+    }
+};
+
+// Where a build goes without the compile cache. Unique per compile: a
+// batch may compile the same source for several problems at once. Kept
+// out of the source's folder, since for checkers and interactors that is
+// a problem folder the catalog watches, and a write there would reload it.
+inline std::string privateBuildPath(const std::string& cppPath, const JudgeOptions& options) {
+    static std::atomic<unsigned> counter{0};
+    std::error_code ec;
+    std::filesystem::path dir = options.cacheDir.parent_path() / "builds";
+    std::filesystem::create_directories(dir, ec);
+    if (ec || access(dir.c_str(), W_OK) != 0) dir = std::filesystem::temp_directory_path(ec);
+    std::string name = std::filesystem::path(cppPath).stem().string() + "." + std::to_string(getpid()) + "-" +
+                       std::to_string(counter++);
+    return (dir / name).string();
+}
+
+// `extraFlags` are added to compileFlags (checkers use them for include
+// paths) and become part of the cache key as well. With
+// options.forkServer the fork-server harness is linked in too.
+inline CompiledSubmission compileSubmission(const std::string& cppPath, const JudgeOptions& options,
+                                            const std::vector<std::string>& extraFlags = {}) {
+    TraceSpan span("compile");
+    CompiledSubmission build;
+    std::string gpp = getGPPPath();
+    std::vector<std::string> flags = compileFlags;
+    flags.insert(flags.end(), extraFlags.begin(), extraFlags.end());
+    // Kept out of `flags`: the precompiled header must not see the object.
+    std::vector<std::string> objects;
+    if (options.forkServer) {
+        std::string error;
+        std::string harness = build_fork_server_harness(gpp, flags, options.cacheDir.parent_path() / "harness", error);
+        if (harness.empty()) {
+            std::cerr << "Warning: " << error << ", running tests without the fork server\n";
+        } else {
+            objects.push_back(harness);
+            build.forkServer = true;
+        }
+    }
+
+    std::optional<CompileCache> cache;
+    std::string key;
+    if (options.useCache) {
+        cache.emplace(options.cacheDir, options.cacheMaxBytes);
+        if (!cache->usable()) {
+            std::cerr << "Warning: compile cache at " << options.cacheDir << " is not writable, compiling without it\n";
+            cache.reset();
+        }
+    }
+    std::string source;
+    if (cache || options.usePch) {
+        std::ifstream file(cppPath, std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        source = buffer.str();
+    }
+    if (cache) {
+        std::vector<std::string> keyFlags = flags;
+        keyFlags.insert(keyFlags.end(), objects.begin(), objects.end());
+        key = CompileCache::key(gpp, keyFlags, source);
+        if (auto lease = cache->lookup(key)) {
+            build.success = true;
+            build.fromCache = true;
+            build.exePath = lease->path().string();
+            build.cacheLease = std::move(lease);
+            span.detail("cached");
+            return build;
+        }
+    }
+
+    std::optional<PrecompiledHeader> pch;
+    if (options.usePch) {
+        TraceSpan pchSpan("preparePch");
+        PchStore store(options.pchDir, options.pchMaxEntries);
+        pch = store.prepare(gpp, flags, source);
+    }
+
+    std::string target = cache ? cache->stagingPath().string() : privateBuildPath(cppPath, options);
+    RunOptions compile;
+    compile.argv = {gpp, cppPath, "-o", target};
+    compile.argv.insert(compile.argv.end(), objects.begin(), objects.end());
+    compile.argv.insert(compile.argv.end(), flags.begin(), flags.end());
+    if (pch) compile.argv.insert(compile.argv.end(), {"-include", pch->header, "-Winvalid-pch"});
+    auto start = std::chrono::steady_clock::now();
+    build.compiler = run_process(compile);
+    if (pch && build.compiler.started && build.compiler.exitCode != 0 &&
+        build.compiler.err.find("judge_pch.h") != std::string::npos) {
+        // The PCH did not apply (or broke the build); compile as usual.
+        compile.argv.resize(compile.argv.size() - 3);
+        pch.reset();
+        start = std::chrono::steady_clock::now();
+        build.compiler = run_process(compile);
+    }
+    build.compileMs = static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    if (pch) {
+        build.pchUsed = pch->description;
+        build.pchBuilt = pch->builtNow;
+        build.pchSavedMs = std::max(0L, pch->parseMs - pch->loadMs);
+    }
+
+    build.exePath = target;
+    build.ownsExe = true;
+    if (!build.compiler.started || build.compiler.exitCode != 0 || !std::filesystem::exists(target)) {
+        return build;
+    }
+    build.success = true;
+    if (cache) {
+        if (auto lease = cache->insert(key, target)) {
+            build.ownsExe = false;
+            build.exePath = lease->path().string();
+            build.cacheLease = std::move(lease);
+        }
+    }
+    return build;
+}
+
+// Problem data shared by all submissions of a batch, loaded once. Only the
+// test list is kept here; each test is read by loadTest() when it is about
+// to run, so memory does not grow with the size of the test set.
+struct LoadedProblem {
+    int id = 0;                         // folder under problems/ (info.id may say otherwise)
+    ProblemInfo info;
+    ResourceLimits limits;
+    std::vector<TestSource> sources;    // files in tests/, unless there is a pack
+    std::unique_ptr<ProblemPack> pack;
+    std::shared_ptr<const CompiledSubmission> checker;  // compiled info.checker, if any
+    std::string checkerError;                           // why the checker is unusable
+    std::unique_ptr<CheckerPool> checkers;              // running persistent checkers
+    std::shared_ptr<const CompiledSubmission> interactor;  // compiled info.interactor, if any
+    std::string interactorError;
+    std::shared_ptr<TestHistory> history;  // null when history is off
+
+    size_t testCount() const { return pack ? pack->size() : sources.size(); }
+
+    // Packed tests are views into the mapping whose pages are dropped again
+    // on release, raw .in/.out tests are only paths (the kernel is asked to
+    // read them ahead), and JSON tests are decoded into the LoadedTest.
+    std::shared_ptr<const LoadedTest> loadTest(size_t index) const {
+        TraceSpan span("loadTest", "test", static_cast<int64_t>(index + 1));
+        auto test = std::make_shared<LoadedTest>();
+        if (pack) {
+            test->data = pack->test(index);
+            pack->prefetch(index);
+            const ProblemPack* mapped = pack.get();
+            test->onRelease = [mapped, index] { mapped->release(index); };
+            return test;
+        }
+        const TestSource& source = sources[index];
+        if (source.raw()) {
+            test->data = {{}, {}, source.input.native(), source.output.native()};
+            for (const std::filesystem::path& file : {source.input, source.output}) {
+                int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) continue;
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                close(fd);
+            }
+            return test;
+        }
+        std::string buffer, error;
+        if (loadTestSource(source, test->owned, buffer, error)) {
+            test->data = {test->owned.input, test->owned.expected_output, {}, {}};
+        } else {
+            test->error = source.json.string() + ": " + error;
+        }
+        return test;
+    }
+};
+
+// Bytes of a test's stdout and stderr kept for reports; the rest is only
+// streamed through the comparator.
+inline constexpr size_t keptOutputBytes = 64 * 1024;
+
+// Hands an output that ran cleanly to the problem's checker.
+inline CheckResult checkOutput(const LoadedProblem& problem, const TestData& test, std::string_view expected,
+                               std::string_view output) {
+    if (!problem.checker) return {Verdict::JudgeError, problem.checkerError};
+    const std::string& checkerPath = problem.checker->exePath;
+    if (problem.info.checkerMode == "testlib") {
+        return run_testlib_checker(checkerPath, test.input, test.inputPath, expected, test.outputPath, output);
+    }
+    MappedFile inputFile;
+    std::string_view input = test.input;
+    if (test.fromFiles()) {
+        std::string error;
+        if (!inputFile.open(std::string(test.inputPath), error)) return {Verdict::JudgeError, error};
+        input = inputFile.view();
+    }
+    return problem.checkers->check(input, expected, output);
+}
+
+// Runs the submission against the problem's interactor, started like a
+// testlib interactor as `interactor <input> <output> <answer>`: <output> is
+// a scratch file it may write, never a file of the problem. It decides the
+// verdict like a testlib checker. How the submission ended
+// comes first: an interactor complaining about a submission that crashed
+// only saw the crash. The transcript ends up in the outcome's run.out.
+inline TestOutcome runInteractiveTest(const std::string& exePath, const LoadedProblem& problem,
+                                      const TestData& test, const std::atomic<bool>* cancel) {
+    TestOutcome outcome;
+    if (!problem.interactor) {
+        outcome.message = problem.interactorError;
+        return outcome;
+    }
+    TestFiles files;
+    std::string inputFile = files.file("input.txt", test.input, test.inputPath);
+    std::string answerFile = files.file("answer.txt", test.expected_output, test.outputPath);
+    std::string scratchFile = files.file("tout.txt", {}, {});
+    if (!files.error().empty()) {
+        outcome.run.error = files.error();
+        return outcome;
+    }
+
+    InteractionOptions interaction;
+    interaction.solution = {exePath};
+    interaction.interactor = {problem.interactor->exePath, inputFile, scratchFile, answerFile};
+    interaction.solutionLimits = problem.limits;
+    interaction.interactorLimits.cpuTimeMs = checkerTimeoutMs;
+    interaction.interactorLimits.wallTimeMs = problem.limits.wallTimeMs + checkerTimeoutMs;
+    interaction.interactorLimits.memoryBytes = checkerMemoryBytes;
+    interaction.cancel = cancel;
+    interaction.transcriptBytes = keptOutputBytes;
+    InteractionResult result = run_interaction(interaction);
+    outcome.run = std::move(result.solution);
+    if (!result.interactor.started) {
+        outcome.message = "cannot start interactor: " + result.interactor.error;
+        return outcome;
+    }
+
+    outcome.verdict = classify_run(outcome.run, problem.limits);
+    if (outcome.verdict != Verdict::Accepted) return outcome;
+    CheckResult interactor = testlib_result(result.interactor, "interactor");
+    outcome.message = std::move(interactor.message);
+    if (interactor.verdict != Verdict::Accepted) outcome.verdict = interactor.verdict;
+    return outcome;
+}
+
+// Runs the submission on one test case, feeding the input straight into its
+// stdin, and decides the verdict. The output is compared while it is being
+// produced and the submission is killed as soon as it is certainly wrong or
+// exceeds the output limit. Raw .in files are streamed by the kernel and
+// .out files are mapped, so neither is copied into memory. Problems with a
+// checker keep the whole output (up to the output limit) and check it once
+// the run has ended.
+// `launcher` (e.g. a ForkServer) starts the submission instead of exec.
+inline TestOutcome runTestCase(const std::string& exePath, const LoadedProblem& problem, const TestData& test,
+                               const std::atomic<bool>* cancel = nullptr, const ProcessLauncher* launcher = nullptr) {
+    if (!problem.info.interactor.empty()) return runInteractiveTest(exePath, problem, test, cancel);
+    const bool useChecker = !problem.info.checker.empty();
+    RunOptions run;
+    run.argv = {exePath};
+    run.input = test.input;
+    run.cancel = cancel;
+    run.limits = problem.limits;
+    run.launcher = launcher;
+    run.keepOutputBytes = keptOutputBytes;
+    if (useChecker) run.keepOutputBytes = std::max<size_t>(keptOutputBytes, problem.limits.outputBytes);
+
+    TestOutcome outcome;
+    MappedFile expectedFile;
+    std::string_view expected = test.expected_output;
+    if (test.fromFiles()) {
+        std::string error;
+        run.inputFd = open(std::string(test.inputPath).c_str(), O_RDONLY | O_CLOEXEC);
+        if (run.inputFd < 0 || !expectedFile.open(std::string(test.outputPath), error)) {
+            if (run.inputFd >= 0) close(run.inputFd);
+            outcome.run.error = "cannot open test files " + std::string(test.inputPath) + ": " +
+                                (error.empty() ? std::strerror(errno) : error);
+            return outcome;
+        }
+        expected = expectedFile.view();
+    }
+
+    std::unique_ptr<OutputComparator> comparator;
+    if (!useChecker) {
+        comparator = make_comparator(problem.info.compare, expected);
+        run.onOutput = [&](std::string_view chunk) { return comparator->feed(chunk); };
+    }
+    outcome.run = run_process(run);
+    if (run.inputFd >= 0) close(run.inputFd);
+
+    if (outcome.run.outputRejected) {
+        outcome.verdict = Verdict::WrongAnswer;
+        outcome.message = comparator->mismatch();
+        return outcome;
+    }
+    outcome.verdict = classify_run(outcome.run, problem.limits);
+    if (outcome.verdict != Verdict::Accepted) return outcome;
+    if (useChecker) {
+        TraceSpan span("check");
+        CheckResult checked = checkOutput(problem, test, expected, outcome.run.out);
+        outcome.verdict = checked.verdict;
+        outcome.message = std::move(checked.message);
+    } else {
+        TraceSpan span("compare");
+        if (!comparator->finish()) {
+            outcome.verdict = Verdict::WrongAnswer;
+            outcome.message = comparator->mismatch();
+        }
+    }
+    return outcome;
+}
+
+// Compiles a checker or interactor source from the folder of problem
+// `problemID`, with that folder and the judge folder (for judge_checker.h
+// or testlib.h) on the include path. The compile cache keeps the binary
+// between runs.
+inline std::shared_ptr<const CompiledSubmission> compileProblemProgram(int problemID, const std::string& name,
+                                                                       const JudgeOptions& options,
+                                                                       std::string& error) {
+    std::filesystem::path problemDir = problemsDir(options) / std::to_string(problemID);
+    std::filesystem::path source = problemDir / name;
+    if (!std::filesystem::exists(source)) {
+        error = source.string() + " not found";
+    } else {
+        JudgeOptions programOptions = options;
+        programOptions.forkServer = false;  // checkers and interactors are started normally
+        auto build = std::make_shared<CompiledSubmission>(compileSubmission(
+            source.string(), programOptions, {"-I", problemDir.string(), "-I", getJudgeDir().string()}));
+        if (build->success) return build;
+        error = name + " does not compile: " + (build->compiler.started ? build->compiler.err : build->compiler.error);
+        if (error.size() > 4096) error.resize(4096);
+    }
+    std::cerr << "Warning: problem " << problemID << ": " << error << "\n";
+    return nullptr;
+}
+
+// Uses problems/<id>/tests.pack when there is one that is not older than
+// anything in tests/, and the files in tests/ otherwise. No test is read
+// here, only when it runs.
+inline std::shared_ptr<const LoadedProblem> loadProblem(int problemID, const JudgeOptions& options) {
+    TraceSpan span("loadProblem", "problem", problemID);
+    auto problem = std::make_shared<LoadedProblem>();
+    const std::filesystem::path root = problemsDir(options);
+    problem->id = problemID;
+    problem->info = loadProblemInfo(problemID, root);
+    problem->limits = problemLimits(problem->info);
+    if (!problem->info.checker.empty()) {
+        problem->checker = compileProblemProgram(problemID, problem->info.checker, options, problem->checkerError);
+        if (problem->checker) problem->checkers = std::make_unique<CheckerPool>(problem->checker->exePath);
+    }
+    if (!problem->info.interactor.empty()) {
+        problem->interactor =
+            compileProblemProgram(problemID, problem->info.interactor, options, problem->interactorError);
+    }
+
+    std::error_code ec;
+    std::filesystem::path packPath = problemPackPath(problemID, root);
+    std::filesystem::path testsDir = packPath.parent_path() / "tests";
+    if (std::filesystem::exists(packPath, ec)) {
+        std::string error;
+        if (problemPackIsStale(packPath, testsDir)) {
+            std::cerr << "Warning: " << packPath.string() << " is older than " << testsDir.string()
+                      << ", ignoring it (rebuild with --pack " << problemID << ")\n";
+        } else if (auto pack = ProblemPack::open(packPath, error)) {
+            problem->pack = std::move(pack);
+        } else {
+            std::cerr << "Warning: ignoring " << packPath.string() << ": " << error << "\n";
+        }
+    }
+    if (!problem->pack) problem->sources = listTestSources(problemID, root);
+
+    if (options.useHistory) {
+        // Adding, removing or renaming tests (or repacking) starts over.
+        struct stat st {};
+        stat((problem->pack ? packPath : testsDir).c_str(), &st);
+        int64_t version = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        problem->history = std::make_shared<TestHistory>(
+            test_history_path(options.historyDir, testsDir.parent_path()), problem->testCount(), version);
+    }
+    return problem;
+}
+
+// Execution order for `problem`, from its history if it keeps one.
+inline std::vector<size_t> testOrder(const LoadedProblem& problem, unsigned workers) {
+    return problem.history ? problem.history->order(workers) : std::vector<size_t>{};
+}
+
+// Feeds a reported test outcome into the problem's history. Judge Errors
+// say nothing about the test and are left out.
+inline void recordTestOutcome(const LoadedProblem& problem, size_t index, const TestOutcome& outcome) {
+    if (!problem.history || outcome.verdict == Verdict::JudgeError) return;
+    problem.history->record(index, !outcome.passed(), outcome.run.wallTimeMs);
+}
+
+// Tests loaded ahead of the workers that run them.
+inline constexpr size_t testReadAhead = 2;
+
+// Runs one test taken from `tests` and lets go of its data afterwards. A
+// test file that cannot be read or decoded is a Judge Error for that test.
+inline TestOutcome runPrefetchedTest(const std::string& exePath, const LoadedProblem& problem,
+                                     TestPrefetcher& tests, size_t index, const std::atomic<bool>* cancel,
+                                     const ProcessLauncher* launcher = nullptr) {
+    TraceSpan span("test", "test", static_cast<int64_t>(index + 1));
+    TraceSpan acquireSpan("acquireTest");
+    std::shared_ptr<const LoadedTest> test = tests.acquire(index);
+    acquireSpan.end();
+    TestOutcome outcome;
+    if (test->error.empty()) {
+        outcome = runTestCase(exePath, problem, test->data, cancel, launcher);
+    } else {
+        outcome.run.error = test->error;
+        outcome.message = test->error;
+    }
+    TraceSpan releaseSpan("releaseTest");
+    tests.release(index);
+    releaseSpan.end();
+    span.detail(outcome.run.cancelled ? "cancelled" : verdict_code(outcome.verdict));
+    return outcome;
+}
+
+// Starts a fork server for `build` if it was linked with the harness and
+// the problem runs it directly (interactive problems start it themselves).
+// Null means every test is started with a fresh exec.
+inline std::unique_ptr<ForkServer> startForkServer(const CompiledSubmission& build, const LoadedProblem& problem) {
+    if (!build.forkServer || !problem.info.interactor.empty()) return nullptr;
+    TraceSpan span("startForkServer");
+    std::string error;
+    std::unique_ptr<ForkServer> server = ForkServer::start(build.exePath, problem.limits, error);
+    if (!server) std::cerr << "Warning: cannot start fork server: " << error << "\n";
+    return server;
+}
+
+// Writes the phases recorded so far to options.tracePath, if tracing.
+inline void writeTrace(const JudgeOptions& options) {
+    if (options.tracePath.empty()) return;
+    std::string error;
+    if (write_chrome_trace(options.tracePath, error)) {
+        std::cerr << "Trace written to " << options.tracePath << "\n";
+    } else {
+        std::cerr << "Warning: " << error << "\n";
+    }
+}
+
+// A submission compiled on a background thread while the first tests of
+// its problem are loaded (or mapped) in execution order, so testing starts
+// as soon as the binary is linked rather than after it has been linked and
+// the tests read. `problem` and `options` must outlive it.
+class StagedSubmission {
+public:
+    StagedSubmission(const std::string& cppPath, const LoadedProblem& problem, const JudgeOptions& options,
+                     unsigned workers)
+        : build_(std::async(std::launch::async, [cppPath, &options] { return compileSubmission(cppPath, options); })),
+          order_(testOrder(problem, workers)),
+          tests_(problem.testCount(), workers + testReadAhead, [&problem](size_t i) { return problem.loadTest(i); },
+                 order_) {}
+
+    StagedSubmission(const StagedSubmission&) = delete;
+    StagedSubmission& operator=(const StagedSubmission&) = delete;
+
+    // Waits for the compile. If it failed, loading ahead stops; the tests
+    // already loaded are dropped with the submission.
+    const CompiledSubmission& build() {
+        if (!ready_) {
+            TraceSpan span("awaitCompile");
+            build_.wait();
+            ready_ = true;
+            if (!build_.get().success) tests_.stop();
+        }
+        return build_.get();
+    }
+
+    TestPrefetcher& tests() { return tests_; }
+    const std::vector<size_t>& order() const { return order_; }
+
+private:
+    std::shared_future<CompiledSubmission> build_;   // waits for the compile when destroyed
+    std::vector<size_t> order_;
+    TestPrefetcher tests_;
+    bool ready_ = false;
+};
+
+// Fills in the compile part of `record`. Returns false if the submission did
+// not compile, in which case its verdict is already final.
+inline bool recordCompile(SubmissionRecord& record, const CompiledSubmission& build) {
+    record.fromCache = build.fromCache;
+    record.compileMs = build.compileMs;
+    if (build.success) return true;
+    record.verdict = build.compiler.started ? Verdict::CompilationError : Verdict::JudgeError;
+    record.message = build.compiler.started ? build.compiler.err : build.compiler.error;
+    if (record.message.size() > 4096) record.message.resize(4096);
+    return false;
+}
+
+// Wrong answers keep the start of the output for the report.
+inline constexpr size_t reportedOutputBytes = 1024;
+
+// Appends the outcome of test `index`, reported in index order, to `record`.
+inline void recordTest(SubmissionRecord& record, const LoadedProblem& problem, size_t index,
+                       const TestOutcome& outcome) {
+    recordTestOutcome(problem, index, outcome);
+    TestRecord test{index + 1, outcome.verdict, outcome.run.cpuTimeMs, outcome.run.wallTimeMs,
+                    outcome.run.peakMemoryKb, {}, outcome.message};
+    if (outcome.verdict == Verdict::WrongAnswer) test.output = outcome.run.out.substr(0, reportedOutputBytes);
+    record.tests.push_back(std::move(test));
+    if (outcome.passed()) ++record.passed;
+}
+
+// Sets the overall verdict once the tests up to `failed` (the first
+// failing test, or the test count) have been recorded.
+inline void recordVerdict(SubmissionRecord& record, size_t failed) {
+    if (failed < record.total) {
+        record.failedTest = failed + 1;
+        record.verdict = record.tests[failed].verdict;
+    } else {
+        record.verdict = Verdict::Accepted;
+    }
+}
+
+// Runs the tests of `problem` against a compiled submission, taking them
+// from `tests` in `order`, and fills in the per-test records and the
+// overall verdict.
+inline void judgeCompiled(SubmissionRecord& record, const LoadedProblem& problem, const CompiledSubmission& build,
+                          TestPrefetcher& tests, const std::vector<size_t>& order, unsigned workers, bool allTests) {
+    TraceSpan span("judge");
+    const std::string& exePath = build.exePath;
+    const size_t count = problem.testCount();
+    std::unique_ptr<ForkServer> server = startForkServer(build, problem);
+    record.total = count;
+    auto runTest = [&](size_t i, const std::atomic<bool>& cancel) {
+        return runPrefetchedTest(exePath, problem, tests, i, &cancel, server.get());
+    };
+    auto report = [&](size_t i, const TestOutcome& outcome) { recordTest(record, problem, i, outcome); };
+    size_t failed = run_test_cases(count, workers, runTest, report, !allTests, order);
+    TraceSpan cleanup("cleanup");
+    server.reset();
+    if (problem.history) problem.history->save();
+    cleanup.end();
+    recordVerdict(record, failed);
+}
+
+inline void judgeCompiled(SubmissionRecord& record, const LoadedProblem& problem, const CompiledSubmission& build,
+                          unsigned workers, bool allTests) {
+    std::vector<size_t> order = testOrder(problem, workers);
+    TestPrefetcher tests(problem.testCount(), workers + testReadAhead, [&](size_t i) { return problem.loadTest(i); },
+                         order);
+    judgeCompiled(record, problem, build, tests, order, workers, allTests);
+}
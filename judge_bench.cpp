@@ -0,0 +1,423 @@
+// Microbenchmarks for the judge's own overhead: loading tests (JSON, raw
+// .in/.out, packs), starting and reaping processes, capturing output and
+// comparing it. They run over synthetic problems generated from a fixed
+// seed, so two runs on the same machine measure the same work:
+//
+//   tiny  10000 tests of a few bytes (process and per-test overhead)
+//   huge  10 tests of several megabytes (throughput)
+//
+// Results are written as JSON. Given a previous result file with
+// --baseline, benchmarks whose median got slower than --tolerance are
+// reported and the exit status is 1.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "comparator.h"
+#include "problem_pack.h"
+#include "problems.h"
+#include "process_runner.h"
+#include "report.h"
+
+struct BenchOptions {
+    std::string filter;                  // only benchmarks whose name contains this
+    long minTimeMs = 500;                // measure each benchmark at least this long
+    size_t minIterations = 5;
+    bool quick = false;                  // smaller problems, for smoke runs
+    std::string outPath;                 // empty = stdout
+    std::string baselinePath;
+    double tolerance = 0.10;             // allowed median slowdown against the baseline
+    std::filesystem::path workDir;       // synthetic problems; empty = a temporary directory
+};
+
+struct BenchResult {
+    std::string name;
+    size_t iterations = 0;
+    double items = 0;                    // tests, processes or comparisons per iteration
+    double bytes = 0;                    // bytes handled per iteration
+    double medianNs = 0;
+    double minNs = 0;
+    double p90Ns = 0;
+    double meanNs = 0;
+};
+
+// A generated problem: its tests as JSON files, as raw .in/.out files and
+// as a pack, plus the decoded tests for the benchmarks that need them.
+struct SyntheticProblem {
+    std::string name;
+    std::vector<TestSource> json;
+    std::vector<TestSource> raw;
+    std::filesystem::path pack;
+    std::vector<TestCase> tests;
+    size_t bytes = 0;                    // input + output of all tests
+};
+
+namespace bench_detail {
+
+// Lines of `perLine` random integers until about `size` bytes.
+inline std::string random_lines(std::mt19937& rng, size_t size, int perLine) {
+    std::uniform_int_distribution<int> value(-1000000000, 1000000000);
+    std::string text;
+    text.reserve(size + 32);
+    while (text.size() < size) {
+        for (int i = 0; i < perLine; ++i) {
+            if (i) text += ' ';
+            text += std::to_string(value(rng));
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+inline bool write_file(const std::filesystem::path& path, std::string_view data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+inline SyntheticProblem make_problem(const std::filesystem::path& root, const std::string& name, size_t count,
+                                     size_t inputBytes, size_t outputBytes, int perLine) {
+    SyntheticProblem problem;
+    problem.name = name;
+    std::filesystem::path dir = root / name;
+    std::filesystem::create_directories(dir / "json");
+    std::filesystem::create_directories(dir / "raw");
+    std::mt19937 rng(static_cast<unsigned>(count * 31 + inputBytes));
+    char stem[32];
+    for (size_t i = 0; i < count; ++i) {
+        TestCase test;
+        test.input = random_lines(rng, inputBytes, perLine);
+        test.expected_output = random_lines(rng, outputBytes, perLine);
+        std::snprintf(stem, sizeof(stem), "%05zu", i + 1);
+
+        TestSource json;
+        json.json = dir / "json" / (std::string("test") + stem + ".json");
+        write_file(json.json, "{\"input\": \"" + json_escape(test.input) + "\", \"output\": \"" +
+                                  json_escape(test.expected_output) + "\"}\n");
+        TestSource raw;
+        raw.input = dir / "raw" / (std::string(stem) + ".in");
+        raw.output = dir / "raw" / (std::string(stem) + ".out");
+        write_file(raw.input, test.input);
+        write_file(raw.output, test.expected_output);
+
+        problem.bytes += test.input.size() + test.expected_output.size();
+        problem.json.push_back(std::move(json));
+        problem.raw.push_back(std::move(raw));
+        problem.tests.push_back(std::move(test));
+    }
+    problem.pack = dir / "tests.pack";
+    std::string error;
+    if (!writeProblemPack(problem.pack, problem.raw, error)) {
+        std::cerr << "Warning: cannot write " << problem.pack.string() << ": " << error << "\n";
+        problem.pack.clear();
+    }
+    return problem;
+}
+
+// Keeps the optimizer from dropping work whose result is unused.
+inline void consume(size_t value) {
+    static volatile size_t sink;
+    sink = sink + value;
+}
+
+} // namespace bench_detail
+
+// Runs the benchmarks selected by options.filter and collects the results.
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchOptions& options) : options_(options) {}
+
+    // Runs `body` once to warm up, then until both the minimum time and the
+    // minimum number of iterations are reached, timing every iteration.
+    void run(const std::string& name, double items, double bytes, const std::function<void()>& body) {
+        if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) return;
+        using Clock = std::chrono::steady_clock;
+        body();
+        std::vector<double> samples;
+        const Clock::time_point start = Clock::now();
+        const auto minTime = std::chrono::milliseconds(options_.minTimeMs);
+        while (samples.size() < options_.minIterations || Clock::now() - start < minTime) {
+            Clock::time_point before = Clock::now();
+            body();
+            samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - before).count());
+        }
+        std::sort(samples.begin(), samples.end());
+        BenchResult result;
+        result.name = name;
+        result.iterations = samples.size();
+        result.items = items;
+        result.bytes = bytes;
+        result.medianNs = samples[samples.size() / 2];
+        result.minNs = samples.front();
+        result.p90Ns = samples[std::min(samples.size() - 1, samples.size() * 9 / 10)];
+        double total = 0;
+        for (double s : samples) total += s;
+        result.meanNs = total / static_cast<double>(samples.size());
+        std::fprintf(stderr, "%-28s %8zu iter %14.0f ns/iter %12.0f ns/item\n", name.c_str(), result.iterations,
+                     result.medianNs, items > 0 ? result.medianNs / items : 0.0);
+        results_.push_back(std::move(result));
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+private:
+    const BenchOptions& options_;
+    std::vector<BenchResult> results_;
+};
+
+inline void bench_loading(BenchRunner& bench, const SyntheticProblem& problem) {
+    const double count = static_cast<double>(problem.tests.size());
+    const double bytes = static_cast<double>(problem.bytes);
+    auto load = [&](const std::vector<TestSource>& sources) {
+        TestCase test;
+        std::string buffer, error;
+        size_t total = 0;
+        for (const TestSource& source : sources) {
+            if (!loadTestSource(source, test, buffer, error)) std::cerr << "Warning: " << error << "\n";
+            total += test.input.size() + test.expected_output.size();
+        }
+        bench_detail::consume(total);
+    };
+    bench.run("load_json/" + problem.name, count, bytes, [&] { load(problem.json); });
+    bench.run("load_raw/" + problem.name, count, bytes, [&] { load(problem.raw); });
+    if (!problem.pack.empty()) {
+        bench.run("load_pack/" + problem.name, count, bytes, [&] {
+            std::string error;
+            std::unique_ptr<ProblemPack> pack = ProblemPack::open(problem.pack, error);
+            size_t total = 0;
+            for (size_t i = 0; pack && i < pack->size(); ++i) {
+                TestData test = pack->test(i);
+                // Touch every page, as writing the input to the child would.
+                for (size_t at = 0; at < test.input.size(); at += 4096) total += test.input[at];
+                for (size_t at = 0; at < test.expected_output.size(); at += 4096) total += test.expected_output[at];
+            }
+            bench_detail::consume(total);
+        });
+    }
+}
+
+// Process creation and teardown alone, with nothing to read or write.
+inline void bench_spawn(BenchRunner& bench) {
+    RunOptions run;
+    run.argv = {resolve_executable("true")};
+    bench.run("spawn/true", 1, 0, [&] {
+        RunResult result = run_process(run);
+        if (!result.started || result.exitCode != 0) std::cerr << "Warning: true failed: " << result.error << "\n";
+    });
+}
+
+// Writing each test's input to `cat` and capturing what comes back, then
+// the same with the output fed to a comparator as it arrives (the path a
+// judged test takes). `limit` caps the tests used per iteration.
+inline void bench_capture(BenchRunner& bench, const SyntheticProblem& problem, size_t limit) {
+    const size_t count = std::min(limit, problem.tests.size());
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) bytes += problem.tests[i].input.size();
+    const std::string cat = resolve_executable("cat");
+    bench.run("capture/" + problem.name, static_cast<double>(count), static_cast<double>(bytes), [&] {
+        for (size_t i = 0; i < count; ++i) {
+            RunOptions run;
+            run.argv = {cat};
+            run.input = problem.tests[i].input;
+            RunResult result = run_process(run);
+            if (result.out.size() != run.input.size()) std::cerr << "Warning: cat lost output\n";
+        }
+    });
+    bench.run("capture_compare/" + problem.name, static_cast<double>(count), static_cast<double>(bytes), [&] {
+        for (size_t i = 0; i < count; ++i) {
+            // cat echoes the input, so the input is also the expected output.
+            std::unique_ptr<OutputComparator> comparator = make_comparator({}, problem.tests[i].input);
+            RunOptions run;
+            run.argv = {cat};
+            run.input = problem.tests[i].input;
+            run.keepOutputBytes = 0;
+            run.onOutput = [&](std::string_view chunk) { return comparator->feed(chunk); };
+            RunResult result = run_process(run);
+            if (result.outputRejected || !comparator->finish()) std::cerr << "Warning: cat output differs\n";
+        }
+    });
+}
+
+// Matching output is the expensive case: every byte has to be looked at.
+// It is fed in pipe-sized chunks, as run_process() delivers it.
+inline void bench_compare(BenchRunner& bench, const SyntheticProblem& problem) {
+    size_t bytes = 0;
+    for (const TestCase& test : problem.tests) bytes += test.expected_output.size();
+    for (ComparePolicy policy : {ComparePolicy::Trimmed, ComparePolicy::Exact, ComparePolicy::Lines,
+                                 ComparePolicy::Tokens, ComparePolicy::Float}) {
+        CompareOptions compare;
+        compare.policy = policy;
+        std::string name = std::string("compare_") + compare_policy_name(policy) + "/" + problem.name;
+        bench.run(name, static_cast<double>(problem.tests.size()), static_cast<double>(bytes), [&] {
+            constexpr size_t chunk = 1 << 16;
+            size_t matched = 0;
+            for (const TestCase& test : problem.tests) {
+                std::unique_ptr<OutputComparator> comparator = make_comparator(compare, test.expected_output);
+                std::string_view output = test.expected_output;
+                bool ok = true;
+                for (size_t at = 0; ok && at < output.size(); at += chunk) {
+                    ok = comparator->feed(output.substr(at, chunk));
+                }
+                matched += ok && comparator->finish();
+            }
+            if (matched != problem.tests.size()) std::cerr << "Warning: " << name << " rejected equal output\n";
+        });
+    }
+}
+
+inline void write_results_json(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "{\n  \"benchmarks\": {";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        double seconds = r.medianNs / 1e9;
+        out << (i ? ",\n    " : "\n    ") << "\"" << json_escape(r.name) << "\": {\"iterations\": " << r.iterations
+            << ", \"items\": " << r.items << ", \"bytes\": " << r.bytes << ", \"medianNs\": " << r.medianNs
+            << ", \"minNs\": " << r.minNs << ", \"p90Ns\": " << r.p90Ns << ", \"meanNs\": " << r.meanNs
+            << ", \"nsPerItem\": " << (r.items > 0 ? r.medianNs / r.items : 0.0)
+            << ", \"mbPerSecond\": " << (r.bytes > 0 && seconds > 0 ? r.bytes / seconds / 1e6 : 0.0) << "}";
+    }
+    out << "\n  }\n}\n";
+}
+
+// Median times by benchmark name from a file written by write_results_json().
+inline bool read_baseline(const std::string& path, std::map<std::string, double>& medians, std::string& error) {
+    std::string json;
+    if (!readFile(path, json)) {
+        error = "cannot read " + path;
+        return false;
+    }
+    JsonReader reader(json);
+    std::string key, name;
+    reader.beginObject();
+    while (reader.nextKey(key)) {
+        if (key != "benchmarks") {
+            reader.skipValue();
+            continue;
+        }
+        reader.beginObject();
+        while (reader.nextKey(name)) {
+            reader.beginObject();
+            while (reader.nextKey(key)) {
+                double value = 0;
+                if (key == "medianNs" && reader.readNumber(value)) {
+                    medians[name] = value;
+                } else if (key != "medianNs") {
+                    reader.skipValue();
+                }
+            }
+        }
+    }
+    reader.end();
+    error = reader.error();
+    return reader.ok();
+}
+
+int run_benchmarks(const BenchOptions& options) {
+    namespace fs = std::filesystem;
+    fs::path root = options.workDir;
+    bool removeRoot = false;
+    if (root.empty()) {
+        root = fs::temp_directory_path() / ("cpp-judge-bench." + std::to_string(getpid()));
+        removeRoot = true;
+    }
+    std::cerr << "Generating synthetic problems in " << root.string() << "\n";
+    std::vector<SyntheticProblem> problems;
+    problems.push_back(bench_detail::make_problem(root, "tiny", options.quick ? 1000 : 10000, 8, 8, 2));
+    const size_t hugeBytes = options.quick ? (1 << 20) : (8 << 20);
+    problems.push_back(bench_detail::make_problem(root, "huge", options.quick ? 2 : 10, hugeBytes, hugeBytes, 10));
+
+    BenchRunner bench(options);
+    for (const SyntheticProblem& problem : problems) {
+        bench_loading(bench, problem);
+        bench_compare(bench, problem);
+        // A few hundred processes per iteration are plenty for tiny tests.
+        bench_capture(bench, problem, 200);
+    }
+    bench_spawn(bench);
+    const std::vector<BenchResult>& results = bench.results();
+    if (removeRoot) {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+    }
+
+    if (options.outPath.empty()) {
+        write_results_json(std::cout, results);
+    } else {
+        std::ofstream out(options.outPath);
+        write_results_json(out, results);
+        if (!out) {
+            std::cerr << "Error: cannot write " << options.outPath << "\n";
+            return 2;
+        }
+        std::cerr << "Results written to " << options.outPath << "\n";
+    }
+
+    if (options.baselinePath.empty()) return 0;
+    std::map<std::string, double> baseline;
+    std::string error;
+    if (!read_baseline(options.baselinePath, baseline, error)) {
+        std::cerr << "Error: " << options.baselinePath << ": " << error << "\n";
+        return 2;
+    }
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0) continue;
+        double change = r.medianNs / it->second - 1;
+        if (change > options.tolerance) {
+            std::fprintf(stderr, "Regression: %s is %.1f%% slower (%.0f ns -> %.0f ns)\n", r.name.c_str(),
+                         change * 100, it->second, r.medianNs);
+            ++regressions;
+        }
+    }
+    if (regressions == 0) std::cerr << "No regressions against " << options.baselinePath << "\n";
+    return regressions ? 1 : 0;
+}
+
+void print_usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --filter TEXT     only run benchmarks whose name contains TEXT (e.g. compare_, /tiny)\n";
+    std::cout << "  --min-time MS     measure each benchmark for at least MS milliseconds (default: 500)\n";
+    std::cout << "  --quick           smaller synthetic problems, for a fast smoke run\n";
+    std::cout << "  --out FILE        write the JSON results to FILE (default: stdout)\n";
+    std::cout << "  --baseline FILE   compare medians with an earlier result file; exit 1 on regressions\n";
+    std::cout << "  --tolerance PCT   allowed slowdown against the baseline (default: 10)\n";
+    std::cout << "  --work-dir DIR    keep the synthetic problems in DIR (default: a temporary directory)\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.minTimeMs = std::max(0L, std::atol(argv[++i]));
+        } else if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.outPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baselinePath = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = std::atof(argv[++i]) / 100;
+        } else if (arg == "--work-dir" && i + 1 < argc) {
+            options.workDir = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+    return run_benchmarks(options);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// Checker side of the judge's persistent checker protocol (see checker.h).
+// A persistent checker is started once and then checks test after test,
+// so it avoids one process start and three temporary files per test:
+//
+//     #include "judge_checker.h"
+//
+//     judge_checker::Result check(const judge_checker::Test& test) {
+//         judge_checker::Tokens expected(test.answer), found(test.output);
+//         ...
+//         return judge_checker::wrong("expected 3 numbers");
+//     }
+//
+//     int main() { return judge_checker::serve(check); }
+//
+// Set "checker": "checker.cpp" and "checkerMode": "persistent" in info.json.
+// The checker is compiled with the problem folder and the judge folder on
+// the include path. Anything printed to stdout other than through serve()
+// breaks the protocol; use stderr for debugging.
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace judge_checker {
+
+struct Test {
+    std::string_view input;    // the test's input
+    std::string_view answer;   // the expected output from the test files
+    std::string_view output;   // what the submission printed
+};
+
+struct Result {
+    const char* status;        // "OK", "WA", "PE" or "FAIL"
+    std::string message;
+};
+
+inline Result ok(std::string message = {}) { return {"OK", std::move(message)}; }
+inline Result wrong(std::string message) { return {"WA", std::move(message)}; }
+inline Result presentation(std::string message) { return {"PE", std::move(message)}; }
+// The checker itself found a problem (e.g. a broken answer file).
+inline Result fail(std::string message) { return {"FAIL", std::move(message)}; }
+
+// Whitespace-separated tokens of a text.
+class Tokens {
+public:
+    explicit Tokens(std::string_view text) : text_(text) {}
+
+    bool next(std::string_view& token) {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+        if (pos_ == text_.size()) return false;
+        size_t start = pos_;
+        while (pos_ < text_.size() && !std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+        token = text_.substr(start, pos_ - start);
+        return true;
+    }
+
+    bool nextLong(long long& value) {
+        std::string_view token;
+        if (!next(token)) return false;
+        std::string copy(token);
+        char* end = nullptr;
+        value = std::strtoll(copy.c_str(), &end, 10);
+        return !copy.empty() && *end == '\0';
+    }
+
+    bool nextDouble(double& value) {
+        std::string_view token;
+        if (!next(token)) return false;
+        std::string copy(token);
+        char* end = nullptr;
+        value = std::strtod(copy.c_str(), &end);
+        return !copy.empty() && *end == '\0';
+    }
+
+    // True once only whitespace is left.
+    bool atEnd() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+        return pos_ == text_.size();
+    }
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+namespace detail {
+
+inline bool read_exact(std::string& buffer, size_t size) {
+    buffer.resize(size);
+    return size == 0 || std::fread(buffer.data(), 1, size, stdin) == size;
+}
+
+} // namespace detail
+
+// Answers the judge's requests until it closes stdin. `check` is called once
+// per test with anything callable as Result(const Test&).
+template <typename CheckFunction>
+int serve(CheckFunction check) {
+    std::string input, answer, output;
+    unsigned long long inputSize, answerSize, outputSize;
+    while (std::scanf("TEST %llu %llu %llu", &inputSize, &answerSize, &outputSize) == 3) {
+        if (std::getchar() != '\n') return 3;
+        if (!detail::read_exact(input, inputSize) || !detail::read_exact(answer, answerSize) ||
+            !detail::read_exact(output, outputSize)) {
+            return 3;
+        }
+        Result result = check(Test{input, answer, output});
+        for (char& c : result.message) {
+            if (c == '\n' || c == '\r') c = ' ';
+        }
+        std::printf("%s %s\n", result.status, result.message.c_str());
+        std::fflush(stdout);
+    }
+    return 0;
+}
+
+} // namespace judge_checker
@@ -0,0 +1,470 @@
+#pragma once
+
+// Long-running judge server. Listens on a Unix domain socket, keeps parsed
+// problems in memory and judges submissions on a persistent worker pool.
+//
+// Protocol: one request per line, one JSON response line per request.
+//   JUDGE <problemID> <absolute path>   judge, stop at the first failure
+//   GRADE <problemID> <absolute path>   judge, run every test
+//   STATUS                              queue depth and counters
+//   RELOAD [problemID]                  drop cached problem data
+//   TRACE ON|OFF|CLEAR                  record the judging phases or stop
+//   TRACE <absolute path>               write them as a Chrome trace
+//   PING
+// Submissions go through a bounded queue. When it is full the request is
+// rejected right away with {"status": "busy"} instead of piling up, so
+// clients can back off. SIGINT/SIGTERM stop accepting new work, finish
+// everything already queued, answer the waiting clients and exit. With a
+// cluster, tests run on the connected worker nodes (see cluster.h).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "bounded_queue.h"
+#include "cluster.h"
+#include "judge.h"
+#include "metrics.h"
+#include "problem_catalog.h"
+#include "report.h"
+
+struct ServerOptions {
+    std::string socketPath;            // empty = default_socket_path()
+    size_t queueCapacity = 64;         // queued submissions before "busy"
+    MetricsOptions metrics;            // Prometheus endpoint and/or textfile
+    ClusterOptions cluster;            // hand tests to worker nodes
+};
+
+inline std::string default_socket_path() {
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+        return std::string(runtime) + "/cpp-judge.sock";
+    }
+    return "/tmp/cpp-judge-" + std::to_string(getuid()) + ".sock";
+}
+
+// Parsed problems kept in memory between requests. Each problem is loaded
+// once; concurrent requests for a problem that is still loading wait for
+// the same load. get() throws what the load threw.
+class ProblemCache {
+public:
+    explicit ProblemCache(const JudgeOptions& options) : options_(options) {}
+
+    std::shared_ptr<const LoadedProblem> get(int problemID) {
+        std::shared_future<std::shared_ptr<const LoadedProblem>> entry;
+        std::promise<std::shared_ptr<const LoadedProblem>> loader;
+        bool mustLoad = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = problems_.find(problemID);
+            if (it == problems_.end()) {
+                entry = loader.get_future().share();
+                problems_.emplace(problemID, entry);
+                mustLoad = true;
+            } else {
+                entry = it->second;
+            }
+        }
+        if (mustLoad) {
+            try {
+                loader.set_value(loadProblem(problemID, options_));
+            } catch (...) {
+                // Waiters get the exception; the next request tries again.
+                loader.set_exception(std::current_exception());
+                invalidate(problemID);
+            }
+        }
+        return entry.get();
+    }
+
+    void invalidate(int problemID) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        problems_.erase(problemID);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        problems_.clear();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return problems_.size();
+    }
+
+private:
+    const JudgeOptions options_;
+    mutable std::mutex mutex_;
+    std::map<int, std::shared_future<std::shared_ptr<const LoadedProblem>>> problems_;
+};
+
+namespace server_detail {
+
+inline int shutdownPipe[2] = {-1, -1};
+
+inline void on_shutdown_signal(int) {
+    char byte = 1;
+    (void)!write(shutdownPipe[1], &byte, 1);
+}
+
+inline bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+inline sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+} // namespace server_detail
+
+// Connects to a running server. Returns -1 and sets `error` on failure.
+inline int connect_to_judge_server(const std::string& socketPath, std::string& error) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return -1;
+    }
+    sockaddr_un addr = server_detail::socket_address(socketPath);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = "cannot connect to " + socketPath + ": " + std::strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends one request line and returns the response line.
+inline bool judge_server_request(int fd, const std::string& request, std::string& response) {
+    if (!server_detail::send_all(fd, request + "\n")) return false;
+    response.clear();
+    char c;
+    while (true) {
+        ssize_t n = recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (c == '\n') return true;
+        response.push_back(c);
+    }
+}
+
+inline int run_judge_server(const ServerOptions& server, const JudgeOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    using server_detail::send_all;
+
+    const std::string socketPath = server.socketPath.empty() ? default_socket_path() : server.socketPath;
+    const unsigned workerCount = std::max(1u, options.jobs);
+
+    // Refuse to take over the socket of a server that is still running.
+    std::string ignored;
+    if (int probe = connect_to_judge_server(socketPath, ignored); probe >= 0) {
+        close(probe);
+        std::cerr << "Error: a judge server is already listening on " << socketPath << "\n";
+        return 1;
+    }
+    unlink(socketPath.c_str());
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr = server_detail::socket_address(socketPath);
+    mode_t oldMask = umask(0177);  // socket usable by this user only
+    bool bound = listenFd >= 0 && bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(oldMask);
+    if (!bound || listen(listenFd, 128) != 0) {
+        std::cerr << "Error: cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+        if (listenFd >= 0) close(listenFd);
+        return 1;
+    }
+
+    if (pipe2(server_detail::shutdownPipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        std::cerr << "Error: pipe: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    struct sigaction action {};
+    action.sa_handler = server_detail::on_shutdown_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    struct Job {
+        BatchItem item;
+        bool allTests = false;
+        Clock::time_point enqueued;
+        std::promise<std::string> response;
+    };
+
+    ProblemCache problems(options);
+    // Edits under problems/ drop only the edited problem from the cache.
+    ProblemCatalog catalog;
+    catalog.load();
+    if (!catalog.watch([&](int problemID) {
+            problems.invalidate(problemID);
+            std::cerr << "Problem " << problemID << " changed, reloading it on next use\n";
+        })) {
+        std::cerr << "Warning: cannot watch " << getProblemsPath() << ", use RELOAD after editing problems\n";
+    }
+    BoundedQueue<std::unique_ptr<Job>> queue(server.queueCapacity);
+    std::atomic<bool> draining{false};
+    std::atomic<unsigned> busyWorkers{0};
+    std::atomic<uint64_t> judged{0}, rejected{0};
+    JudgeMetrics metrics;
+    MetricsExporter exporter(server.metrics, [&] {
+        ServiceGauges gauges{queue.size(), queue.capacity(), workerCount, busyWorkers.load(), rejected.load()};
+        std::ostringstream out;
+        metrics.writePrometheus(out, gauges);
+        return out.str();
+    });
+    if (std::string error; !exporter.start(error)) std::cerr << "Warning: metrics: " << error << "\n";
+    std::unique_ptr<ClusterCoordinator> cluster;
+    if (!server.cluster.listen.empty()) {
+        cluster = std::make_unique<ClusterCoordinator>(server.cluster, options);
+        if (std::string error; !cluster->start(error)) {
+            std::cerr << "Error: cluster: " << error << "\n";
+            close(listenFd);
+            unlink(socketPath.c_str());
+            return 1;
+        }
+    }
+
+    auto worker = [&] {
+        while (auto job = queue.pop()) {
+            ++busyWorkers;
+            Job& j = **job;
+            long queueMs = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - j.enqueued).count());
+            Clock::time_point started = Clock::now();
+
+            SubmissionRecord record;
+            record.item = j.item;
+            bool compiled = false;
+            std::shared_ptr<const LoadedProblem> problem;
+            std::string loadError;
+            try {
+                if (catalog.find(j.item.problemID)) problem = problems.get(j.item.problemID);
+            } catch (const std::exception& e) {
+                loadError = e.what();
+            }
+            if (!loadError.empty()) {
+                record.message = "cannot load problem " + std::to_string(j.item.problemID) + ": " + loadError;
+            } else if (!problem || problem->testCount() == 0) {
+                record.message = "no test cases for problem " + std::to_string(j.item.problemID);
+            } else if (!std::filesystem::exists(j.item.path)) {
+                record.message = "source file not found";
+            } else {
+                StagedSubmission staged(j.item.path, *problem, options, 1);
+                compiled = true;
+                // Judged here when no worker node is connected.
+                if (recordCompile(record, staged.build()) &&
+                    !(cluster && cluster->judge(record, *problem, staged.build(), j.allTests))) {
+                    judgeCompiled(record, *problem, staged.build(), staged.tests(), staged.order(), 1, j.allTests);
+                }
+            }
+            const Clock::time_point finished = Clock::now();
+            record.judgeMs = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(finished - started).count());
+            auto micros = [](Clock::duration d) {
+                return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+            };
+            metrics.recordSubmission(record, micros(started - j.enqueued), micros(finished - started), compiled);
+
+            std::ostringstream out;
+            out << "{\"status\": \"ok\", \"queueMs\": " << queueMs << ", \"result\": ";
+            write_submission_json(out, record);
+            out << "}";
+            j.response.set_value(out.str());
+            ++judged;
+            --busyWorkers;
+        }
+    };
+
+    auto handleLine = [&](const std::string& line) -> std::string {
+        std::istringstream in(line);
+        std::string command;
+        in >> command;
+        if (command == "PING") return "{\"status\": \"ok\"}";
+        if (command == "STATUS") {
+            std::ostringstream out;
+            out << "{\"status\": \"ok\", \"queued\": " << queue.size() << ", \"capacity\": " << queue.capacity()
+                << ", \"workers\": " << workerCount << ", \"busyWorkers\": " << busyWorkers.load()
+                << ", \"judged\": " << judged.load() << ", \"rejected\": " << rejected.load()
+                << ", \"problems\": " << catalog.size() << ", \"problemsCached\": " << problems.size()
+                << ", \"draining\": " << (draining.load() ? "true" : "false");
+            if (cluster) out << ", \"nodes\": " << cluster->nodeCount() << ", \"nodeSlots\": " << cluster->slotCount();
+            out << "}";
+            return out.str();
+        }
+        if (command == "RELOAD") {
+            catalog.load();
+            int problemID = 0;
+            if (in >> problemID) {
+                problems.invalidate(problemID);
+            } else {
+                problems.clear();
+            }
+            return "{\"status\": \"ok\"}";
+        }
+        if (command == "TRACE") {
+            std::string arg;
+            std::getline(in >> std::ws, arg);
+            if (arg == "ON" || arg == "OFF") {
+                set_tracing_enabled(arg == "ON");
+            } else if (arg == "CLEAR") {
+                clear_trace();
+            } else if (std::filesystem::path(arg).is_absolute()) {
+                std::string error;
+                if (!write_chrome_trace(arg, error)) {
+                    return "{\"status\": \"error\", \"message\": \"" + json_escape(error) + "\"}";
+                }
+            } else {
+                return "{\"status\": \"error\", \"message\": \"usage: TRACE ON|OFF|CLEAR|<absolute path>\"}";
+            }
+            return "{\"status\": \"ok\", \"tracing\": " + std::string(tracing_enabled() ? "true" : "false") + "}";
+        }
+        if (command == "JUDGE" || command == "GRADE") {
+            auto job = std::make_unique<Job>();
+            job->allTests = command == "GRADE";
+            std::string path;
+            if (!(in >> job->item.problemID) || !std::getline(in >> std::ws, path) || path.empty()) {
+                return "{\"status\": \"error\", \"message\": \"usage: " + command + " <problemID> <path>\"}";
+            }
+            if (!std::filesystem::path(path).is_absolute()) {
+                return "{\"status\": \"error\", \"message\": \"path must be absolute\"}";
+            }
+            job->item.path = path;
+            job->enqueued = Clock::now();
+            std::future<std::string> response = job->response.get_future();
+            if (draining.load()) return "{\"status\": \"error\", \"message\": \"shutting down\"}";
+            if (!queue.try_push(std::move(job))) {
+                ++rejected;
+                return "{\"status\": \"busy\", \"queued\": " + std::to_string(queue.size()) + "}";
+            }
+            return response.get();
+        }
+        return "{\"status\": \"error\", \"message\": \"unknown command\"}";
+    };
+
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    std::list<Connection> connections;
+
+    auto serve = [&](Connection& conn) {
+        std::string buffer;
+        char chunk[4096];
+        while (true) {
+            ssize_t n = recv(conn.fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            buffer.append(chunk, static_cast<size_t>(n));
+            size_t newline;
+            bool ok = true;
+            while (ok && (newline = buffer.find('\n')) != std::string::npos) {
+                std::string line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                ok = send_all(conn.fd, handleLine(line) + "\n");
+            }
+            if (!ok) break;
+        }
+        conn.done = true;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < workerCount; ++i) workers.emplace_back(worker);
+    std::cerr << "Judge server listening on " << socketPath << " with " << workerCount << " worker(s), queue capacity "
+              << queue.capacity() << "\n";
+    if (cluster) std::cerr << "Waiting for worker nodes on " << server.cluster.listen << "\n";
+
+    while (true) {
+        pollfd fds[2] = {{listenFd, POLLIN, 0}, {server_detail::shutdownPipe[0], POLLIN, 0}};
+        if (poll(fds, 2, 1000) < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+
+        // Reap connections whose clients have gone away.
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->done) {
+                it->thread.join();
+                close(it->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        Connection& conn = connections.emplace_back();
+        conn.fd = fd;
+        conn.thread = std::thread(serve, std::ref(conn));
+    }
+
+    // Graceful drain: no new connections or submissions, finish the queue.
+    std::cerr << "Shutting down: finishing " << queue.size() + busyWorkers.load() << " submission(s)\n";
+    draining = true;
+    close(listenFd);
+    unlink(socketPath.c_str());
+    queue.close();
+    for (auto& t : workers) t.join();
+    if (cluster) cluster->stop();
+    exporter.stop();
+    for (auto& conn : connections) {
+        shutdown(conn.fd, SHUT_RDWR);
+        conn.thread.join();
+        close(conn.fd);
+    }
+    close(server_detail::shutdownPipe[0]);
+    close(server_detail::shutdownPipe[1]);
+    writeTrace(options);
+    std::cerr << "Judge server stopped after " << judged.load() << " submission(s)\n";
+    return 0;
+}
+
+// Client side of --submit: sends one submission and prints the response.
+inline int submit_to_judge_server(const std::string& socketPath, int problemID, const std::string& path,
+                                  bool allTests) {
+    std::string error;
+    int fd = connect_to_judge_server(socketPath.empty() ? default_socket_path() : socketPath, error);
+    if (fd < 0) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
+    }
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+    std::string response;
+    bool ok = judge_server_request(
+        fd, std::string(allTests ? "GRADE " : "JUDGE ") + std::to_string(problemID) + " " + absolute.string(), response);
+    close(fd);
+    if (!ok) {
+        std::cerr << "Error: the judge server closed the connection\n";
+        return 1;
+    }
+    std::cout << response << "\n";
+    return 0;
+}
@@ -5,215 +5,38 @@
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
-#include <windows.h>
 #include <algorithm>
 #include <map>
+#include <optional>
+#include "batch.h"
+#include "judge.h"
+#include "judge_server.h"
+#include "problem_catalog.h"
 
-std::string getGPPPath() {
-    char exePath[MAX_PATH];
-    GetModuleFileNameA(NULL, exePath, MAX_PATH);
-    std::filesystem::path judgePath(exePath);
-    std::filesystem::path judgeDir = judgePath.parent_path();
-    std::filesystem::path gppFullPath = judgeDir / "mingw64" / "bin" / "g++.exe";
-    return gppFullPath.string();
-}
-
-std::string getProblemsPath() {
-    char exePath[MAX_PATH];
-    GetModuleFileNameA(NULL, exePath, MAX_PATH);
-    std::filesystem::path judgePath(exePath);
-    std::filesystem::path judgeDir = judgePath.parent_path();
-    std::filesystem::path problemsPath = judgeDir / "problems";
-    return problemsPath.string();
-}
-
-struct TestCase {
-    std::string input;
-    std::string expected_output;
-};
-
-struct ProblemInfo {
-    int id;
-    std::string title;
-    std::string timeLimit;
-    std::string memoryLimit;
-};
-
-// Simple JSON string parser for our specific format
-std::string parseJsonString(const std::string& json, const std::string& key) {
-    size_t keyPos = json.find("\"" + key + "\"");
-    if (keyPos == std::string::npos) return "";
-    
-    size_t colonPos = json.find(":", keyPos);
-    if (colonPos == std::string::npos) return "";
-    
-    size_t startQuote = json.find("\"", colonPos);
-    if (startQuote == std::string::npos) return "";
-    
-    size_t endQuote = startQuote + 1;
-    while (endQuote < json.size()) {
-        if (json[endQuote] == '\"' && json[endQuote-1] != '\\') {
-            break;
-        }
-        endQuote++;
-    }
-    
-    std::string result = json.substr(startQuote + 1, endQuote - startQuote - 1);
-    
-    // Replace escaped newlines
-    size_t pos = 0;
-    while ((pos = result.find("\\n", pos)) != std::string::npos) {
-        result.replace(pos, 2, "\n");
-        pos += 1;
-    }
-    
-    return result;
-}
-
-int parseJsonInt(const std::string& json, const std::string& key) {
-    size_t keyPos = json.find("\"" + key + "\"");
-    if (keyPos == std::string::npos) return 0;
-    
-    size_t colonPos = json.find(":", keyPos);
-    if (colonPos == std::string::npos) return 0;
-    
-    size_t numStart = json.find_first_of("0123456789", colonPos);
-    if (numStart == std::string::npos) return 0;
-    
-    size_t numEnd = json.find_first_not_of("0123456789", numStart);
-    
-    std::string numStr = json.substr(numStart, numEnd - numStart);
-    return std::stoi(numStr);
-}
-
-ProblemInfo loadProblemInfo(int problemID) {
-    ProblemInfo info;
-    info.id = problemID;
-    info.title = "Problem " + std::to_string(problemID);
-    info.timeLimit = "1 second";
-    info.memoryLimit = "256 megabytes";
-    
-    std::string problemsPath = getProblemsPath();
-    std::filesystem::path infoPath = std::filesystem::path(problemsPath) / std::to_string(problemID) / "info.json";
-    
-    if (!std::filesystem::exists(infoPath)) {
-        return info;
-    }
-    
-    std::ifstream file(infoPath);
-    if (!file.is_open()) {
-        return info;
-    }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string json = buffer.str();
-    file.close();
-    
-    info.id = parseJsonInt(json, "id");
-    std::string title = parseJsonString(json, "title");
-    if (!title.empty()) info.title = title;
-    
-    std::string timeLimit = parseJsonString(json, "timeLimit");
-    if (!timeLimit.empty()) info.timeLimit = timeLimit;
-    
-    std::string memLimit = parseJsonString(json, "memoryLimit");
-    if (!memLimit.empty()) info.memoryLimit = memLimit;
-    
-    return info;
-}
-
-std::vector<TestCase> get_testcases(int problemID) {
-    std::vector<TestCase> tc;
-    
-    std::string problemsPath = getProblemsPath();
-    std::filesystem::path testsDir = std::filesystem::path(problemsPath) / std::to_string(problemID) / "tests";
-    
-    if (!std::filesystem::exists(testsDir)) {
-        std::cerr << "Error: Tests directory not found for problem " << problemID << "\n";
-        std::cerr << "Looking in: " << testsDir << "\n";
-        return tc;
-    }
-    
-    // Get all test files and sort them
-    std::vector<std::filesystem::path> testFiles;
-    for (const auto& entry : std::filesystem::directory_iterator(testsDir)) {
-        if (entry.path().extension() == ".json") {
-            testFiles.push_back(entry.path());
-        }
-    }
-    
-    std::sort(testFiles.begin(), testFiles.end());
-    
-    // Load each test file
-    for (const auto& testFile : testFiles) {
-        std::ifstream file(testFile);
-        if (!file.is_open()) continue;
-        
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string json = buffer.str();
-        file.close();
-        
-        TestCase test;
-        test.input = parseJsonString(json, "input");
-        test.expected_output = parseJsonString(json, "output");
-        
-        if (!test.input.empty() && !test.expected_output.empty()) {
-            tc.push_back(test);
-        }
-    }
-    
-    return tc;
-}
-
-std::vector<int> getAvailableProblems() {
-    std::vector<int> problems;
-    std::string problemsPath = getProblemsPath();
-    
-    if (!std::filesystem::exists(problemsPath)) {
-        std::cerr << "Warning: Problems directory not found at: " << problemsPath << "\n";
-        // Return default problems as fallback
-        return {1, 2, 3};
-    }
-    
-    for (const auto& entry : std::filesystem::directory_iterator(problemsPath)) {
-        if (entry.is_directory()) {
-            std::string dirName = entry.path().filename().string();
-            // Check if directory name is a number
-            if (std::all_of(dirName.begin(), dirName.end(), ::isdigit)) {
-                int problemID = std::stoi(dirName);
-                problems.push_back(problemID);
-            }
-        }
+// Raw .in/.out tests can be huge, so only their file name is shown.
+void print_test_data(std::ostream& out, const char* label, std::string_view text, std::string_view path) {
+    if (!path.empty()) {
+        out << label << ": " << path << "\n";
+    } else {
+        out << label << ":\n" << text;
     }
-    
-    std::sort(problems.begin(), problems.end());
-    return problems;
 }
 
-std::string trim(const std::string& s) {
-    size_t first = s.find_first_not_of(" \r\n\t");
-    if (first == std::string::npos) return "";
-    size_t last = s.find_last_not_of(" \r\n\t");
-    return s.substr(first, (last - first + 1));
-}
-
-std::string trim_newlines(const std::string& s) {
-    size_t end = s.find_last_not_of("\r\n");
-    return (end == std::string::npos) ? "" : s.substr(0, end + 1);
-}
-
-void run_submission_tester() {
-    std::vector<int> availableProblems = getAvailableProblems();
+void run_submission_tester(const JudgeOptions& options) {
+    // Problems added or edited while the tester runs show up in the next
+    // round without rescanning the folder.
+    ProblemCatalog catalog;
+    catalog.load();
+    catalog.watch(nullptr);
     
-    if (availableProblems.empty()) {
+    if (catalog.size() == 0) {
         std::cerr << "Error: No problems found!\n";
-        std::cerr << "Please ensure the 'problems' folder exists next to judge.exe\n";
+        std::cerr << "Please ensure the 'problems' folder exists next to the judge executable\n";
         return;
     }
     
     while (true) {
+        std::vector<int> availableProblems = catalog.ids();
         std::cout << "Available problems: ";
         for (size_t i = 0; i < availableProblems.size(); ++i) {
             std::cout << availableProblems[i];
@@ -231,13 +54,16 @@ void run_submission_tester() {
             continue;
         }
         
-        // Load and display problem info
-        ProblemInfo info = loadProblemInfo(problemID);
+        // Each submission gets a trace of its own.
+        if (!options.tracePath.empty()) clear_trace();
+        // Load the problem and display its info
+        auto problem = loadProblem(problemID, options);
+        const ProblemInfo& info = problem->info;
         std::cout << "\n=== " << info.title << " ===\n";
         std::cout << "Time Limit: " << info.timeLimit << "\n";
         std::cout << "Memory Limit: " << info.memoryLimit << "\n\n";
 
-        std::cout << "Enter path to submitted CPP file (e.g., C:\\Users\\admin\\Desktop\\student.cpp):\n";
+        std::cout << "Enter path to submitted CPP file (e.g., /home/admin/student.cpp):\n";
         std::string cppPath;
         std::getline(std::cin, cppPath);
 
@@ -246,94 +72,117 @@ void run_submission_tester() {
             continue;
         }
 
-        // Compile student code (g++)
-        std::string exePath = cppPath + "_submission_build.exe";
-        std::string mingwGPP = getGPPPath();
-        std::string raw_cmd = "\"" + mingwGPP + "\" \"" + cppPath + "\" -o \"" + exePath + "\" -O2 -static -std=c++17";
-        std::string cmd = "cmd /C \"" + raw_cmd + " 2> compile_errors.txt\"";
+        // Compile student code (g++), or reuse a cached binary,
+        // while the first tests are loaded.
         std::cout << "\nCompiling...\n";
-        int compileResult = system(cmd.c_str());
+        StagedSubmission staged(cppPath, *problem, options, options.jobs);
+        const CompiledSubmission& build = staged.build();
+        const std::string& exePath = build.exePath;
         
-        if (compileResult != 0) {
-            std::cout << "Compilation failed. See 'compile_errors.txt' for details.\n";
-            if (std::filesystem::exists(exePath)) std::filesystem::remove(exePath);
-        } else if (!std::filesystem::exists(exePath)) {
-            std::cerr << "Compilation failed (no .exe was produced). Try again.\n";
+        if (!build.success && !build.compiler.started) {
+            std::cerr << "Could not start the compiler: " << build.compiler.error << "\n";
+        } else if (!build.success && build.compiler.exitCode != 0) {
+            std::cout << "Compilation failed:\n" << build.compiler.err;
+        } else if (!build.success) {
+            std::cerr << "Compilation failed (no executable was produced). Try again.\n";
         } else {
-            std::wcout << L"Compilation successful. Running tests...\n\n";
+            if (build.fromCache) {
+                std::cout << "Compilation skipped (identical submission found in the compile cache). Running tests...\n\n";
+            } else {
+                std::cout << "Compilation successful (" << build.compileMs << " ms";
+                if (!build.pchUsed.empty()) {
+                    std::cout << ", precompiled header for " << build.pchUsed
+                              << (build.pchBuilt ? " built now" : "") << ", ~" << build.pchSavedMs << " ms saved";
+                }
+                std::cout << "). Running tests...\n\n";
+            }
             
             // Run test cases
-            auto cases = get_testcases(problemID);
+            const size_t testCount = problem->testCount();
             
-            if (cases.empty()) {
+            if (testCount == 0) {
                 std::cerr << "Error: No test cases found for problem " << problemID << "\n";
                 std::cerr << "Please check the problems/" << problemID << "/tests/ folder.\n";
             } else {
-                std::cout << "Loaded " << cases.size() << " test case(s)\n\n";
+                std::cout << "Found " << testCount << " test case(s)\n\n";
                 
+                TraceSpan judgeSpan("judge");
                 int passed = 0;
                 bool had_failure = false;
-                for (size_t i = 0; i < cases.size(); ++i) {
-                    std::string result;
-                    try {
-                        // Write input to file
-                        std::ofstream inFile("input.txt");
-                        inFile << cases[i].input;
-                        inFile.close();
-                        
-                        // Prepare output file name
-                        std::string outFileName = "output.txt";
-                        std::string runCmd = "\"" + exePath + "\" < input.txt > " + outFileName;
-
-                        // Run it
-                        std::system(runCmd.c_str());
-
-                        // Read the output
-                        std::ifstream outFile(outFileName);
-                        std::stringstream buffer;
-                        buffer << outFile.rdbuf();
-                        result = buffer.str();
-
-                        // Compare output:
-                        result = trim(result);
-                        outFile.close();
-                    } catch (const std::exception& e) {
-                        std::cerr << "\nExecution error: " << e.what() << std::endl;
-                        std::cerr << "Input was:\n" << cases[i].input << std::endl;
-                        std::filesystem::remove(exePath);
+                const ResourceLimits& limits = problem->limits;
+                std::unique_ptr<ForkServer> server = startForkServer(build, *problem);
+                const std::vector<size_t>& order = staged.order();
+                TestPrefetcher& tests = staged.tests();
+                auto runTest = [&](size_t i, const std::atomic<bool>& cancel) {
+                    return runPrefetchedTest(exePath, *problem, tests, i, &cancel, server.get());
+                };
+                auto report = [&](size_t i, const TestOutcome& outcome) {
+                    const RunResult& run = outcome.run;
+                    recordTestOutcome(*problem, i, outcome);
+                    // Only failures show the test, so only they load it again.
+                    std::shared_ptr<const LoadedTest> test;
+                    if (!outcome.passed()) test = problem->loadTest(i);
+                    std::string usage = "(" + std::to_string(run.cpuTimeMs) + " ms CPU, " +
+                                        std::to_string(run.wallTimeMs) + " ms wall, " +
+                                        std::to_string(run.peakMemoryKb) + " KB)";
+                    if (outcome.verdict == Verdict::JudgeError) {
+                        std::cerr << "\nExecution error: " << (run.error.empty() ? outcome.message : run.error)
+                                  << std::endl;
+                        print_test_data(std::cerr, "Input was", test->data.input, test->data.inputPath);
+                        std::cerr << std::endl;
                         had_failure = true;
-                        break;
-                    }
-                    
-                    auto trimmed_result = trim_newlines(result);
-                    auto trimmed_expected = trim_newlines(cases[i].expected_output);
-                    
-                    if (trimmed_result == trimmed_expected) {
-                        std::cout << "Test case #" << (i + 1) << ": Passed.\n";
+                    } else if (outcome.passed()) {
+                        std::cout << "Test case #" << (i + 1) << ": Passed. " << usage << "\n";
                         ++passed;
+                    } else if (outcome.verdict == Verdict::WrongAnswer) {
+                        std::cout << "\nNot Passed!\n";
+                        std::cout << "Fails on test case #" << (i + 1) << ": " << verdict_name(outcome.verdict) << " " << usage << "\n";
+                        if (!outcome.message.empty()) {
+                            const char* label = !info.interactor.empty() ? "Interactor: "
+                                                : !info.checker.empty()  ? "Checker: "
+                                                                         : "Difference at ";
+                            std::cout << label << outcome.message << "\n";
+                        }
+                        print_test_data(std::cout, "Input", test->data.input, test->data.inputPath);
+                        std::cout << (info.interactor.empty() ? "Your Output:\n" : "Transcript (> yours, < interactor):\n")
+                                  << run.out << "\n";
+                        if (run.outputBytes > static_cast<long long>(run.out.size())) {
+                            std::cout << "... (" << run.outputBytes << " bytes read before judging stopped)\n";
+                        }
+                        if (info.interactor.empty()) {
+                            print_test_data(std::cout, "Expected Output", test->data.expected_output, test->data.outputPath);
+                        }
+                        std::cout << "\n";
+                        had_failure = true;
                     } else {
                         std::cout << "\nNot Passed!\n";
-                        std::cout << "Fails on test case #" << (i + 1) << ":\n";
-                        std::cout << "Input:\n" << cases[i].input;
-                        std::cout << "Your Output:\n" << result << "\n";
-                        std::cout << "Expected Output:\n" << cases[i].expected_output << "\n";
+                        std::cout << "Fails on test case #" << (i + 1) << ": " << verdict_name(outcome.verdict) << " " << usage << "\n";
+                        if (outcome.verdict == Verdict::OutputLimitExceeded) {
+                            std::cout << "Output exceeded " << limits.outputBytes << " bytes\n";
+                        } else if (run.termSignal != 0) {
+                            std::cout << "Killed by signal " << run.termSignal << " (" << strsignal(run.termSignal) << ")\n";
+                        } else if (run.exitCode != 0) {
+                            std::cout << "Exit code " << run.exitCode << "\n";
+                        }
+                        print_test_data(std::cout, "Input", test->data.input, test->data.inputPath);
                         had_failure = true;
-                        break;
                     }
-                }
+                };
+                run_test_cases(testCount, options.jobs, runTest, report, true, order);
+                TraceSpan cleanup("cleanup");
+                server.reset();
+                if (problem->history) problem->history->save();
+                cleanup.end();
+                judgeSpan.end();
                 
                 if (!had_failure) {
                     std::cout << "\nAll " << passed << " test cases passed. Congratulations!\n";
                 }
             }
-            
-            // Clean up build file and temporary files
-            if (std::filesystem::exists(exePath)) std::filesystem::remove(exePath);
-            if (std::filesystem::exists("input.txt")) std::filesystem::remove("input.txt");
-            if (std::filesystem::exists("output.txt")) std::filesystem::remove("output.txt");
-            if (std::filesystem::exists("compile_errors.txt")) std::filesystem::remove("compile_errors.txt");
         }
 
+        writeTrace(options);
+
         // Ask user to continue or exit
         std::cout << "\nWould you like to test another submission? (y/n): ";
         std::string answer;
@@ -346,7 +195,147 @@ void run_submission_tester() {
     }
 }
 
-int main() {
+int run_pack(const std::string& target) {
+    std::vector<int> ids;
+    if (target == "all") {
+        // Problems that only have a pack have nothing to pack
+        ProblemCatalog catalog;
+        catalog.load();
+        for (int id : catalog.ids()) {
+            if (catalog.find(id)->testsStamp) ids.push_back(id);
+        }
+    } else {
+        ids.push_back(std::atoi(target.c_str()));
+    }
+    int failures = 0;
+    for (int id : ids) {
+        std::string error;
+        if (packProblem(id, error)) {
+            std::cout << "Packed problem " << id << " into " << problemPackPath(id).string() << "\n";
+        } else {
+            std::cerr << "Error: problem " << id << ": " << error << "\n";
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
+
+void print_usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]                       interactive judging\n";
+    std::cout << "       " << prog << " --batch DIR|MANIFEST [options]  judge many submissions\n";
+    std::cout << "       " << prog << " --serve [options]               run as a judge server\n";
+    std::cout << "       " << prog << " --submit ID FILE [--socket PATH] judge FILE on a running server\n";
+    std::cout << "       " << prog << " --worker HOST:PORT [options]    run tests for a server started with --cluster-listen\n";
+    std::cout << "       " << prog << " --pack ID|all                   build problems/<id>/tests.pack from tests/*.json\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --jobs N          run up to N test cases (server: submissions) at the same time (default: "
+              << default_worker_count() << ", 1 = sequential)\n";
+    std::cout << "  --no-cache        always compile, do not reuse cached binaries\n";
+    std::cout << "  --cache-dir DIR   compile cache location (default: " << default_compile_cache_dir().string() << ")\n";
+    std::cout << "  --cache-size MB   evict least recently used binaries above this size (default: 512, 0 = unbounded)\n";
+    std::cout << "  --no-pch          do not use precompiled headers\n";
+    std::cout << "  --pch-dir DIR     precompiled header location (default: " << default_pch_dir().string() << ")\n";
+    std::cout << "  --fork-server     start each submission once and fork it for every test\n";
+    std::cout << "  --no-history      run tests in file order instead of likely failures first\n";
+    std::cout << "  --history-dir DIR test statistics location (default: " << default_history_dir().string() << ")\n";
+    std::cout << "  --trace FILE      write a Chrome trace of the judging phases to FILE (per submission; batch and\n";
+    std::cout << "                    server: all of them)\n";
+    std::cout << "Batch options:\n";
+    std::cout << "  --problem ID      problem for a directory, or for manifest lines without an ID\n";
+    std::cout << "  --report FILE     write the report to FILE (.json or .csv, default: JSON on stdout)\n";
+    std::cout << "  --compile-jobs N  compile up to N submissions at the same time (default: jobs / 2)\n";
+    std::cout << "  --all-tests       run every test instead of stopping at the first failure\n";
+    std::cout << "Server options:\n";
+    std::cout << "  --socket PATH     Unix socket (default: " << default_socket_path() << ")\n";
+    std::cout << "  --queue N         reject submissions as busy once N are waiting (default: 64)\n";
+    std::cout << "  --metrics-port N  serve Prometheus metrics on http://127.0.0.1:N/metrics\n";
+    std::cout << "  --metrics-file F  rewrite Prometheus metrics to F every 10 seconds\n";
+    std::cout << "  --cluster-listen [HOST:]PORT\n";
+    std::cout << "                    run tests on worker nodes connecting here (HOST defaults to 127.0.0.1)\n";
+    std::cout << "Worker options:\n";
+    std::cout << "  --work-dir DIR    problems and binaries fetched from the server (default: "
+              << default_cluster_work_dir().string() << ")\n";
+    std::cout << "Server and workers authenticate with the token in $JUDGE_CLUSTER_TOKEN.\n";
+}
+
+int main(int argc, char* argv[]) {
+    JudgeOptions options;
+    BatchOptions batch;
+    ServerOptions server;
+    WorkerOptions worker;
+    bool batchMode = false, serveMode = false;
+    int submitProblem = 0;
+    std::string submitPath;
+    std::string packTarget;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--jobs" || arg == "-j") && i + 1 < argc) {
+            int jobs = std::atoi(argv[++i]);
+            options.jobs = jobs > 0 ? static_cast<unsigned>(jobs) : default_worker_count();
+        } else if (arg == "--no-cache") {
+            options.useCache = false;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.cacheDir = argv[++i];
+        } else if (arg == "--no-pch") {
+            options.usePch = false;
+        } else if (arg == "--pch-dir" && i + 1 < argc) {
+            options.pchDir = argv[++i];
+        } else if (arg == "--fork-server") {
+            options.forkServer = true;
+        } else if (arg == "--no-history") {
+            options.useHistory = false;
+        } else if (arg == "--history-dir" && i + 1 < argc) {
+            options.historyDir = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+            set_tracing_enabled(true);
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            options.cacheMaxBytes = std::strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchMode = true;
+            batch.target = argv[++i];
+        } else if (arg == "--problem" && i + 1 < argc) {
+            batch.defaultProblem = std::atoi(argv[++i]);
+        } else if (arg == "--report" && i + 1 < argc) {
+            batch.reportPath = argv[++i];
+        } else if (arg == "--compile-jobs" && i + 1 < argc) {
+            batch.compileJobs = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--all-tests") {
+            batch.allTests = true;
+        } else if (arg == "--pack" && i + 1 < argc) {
+            packTarget = argv[++i];
+        } else if (arg == "--serve") {
+            serveMode = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            server.socketPath = argv[++i];
+        } else if (arg == "--queue" && i + 1 < argc) {
+            server.queueCapacity = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            server.metrics.httpPort = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--metrics-file" && i + 1 < argc) {
+            server.metrics.filePath = argv[++i];
+        } else if (arg == "--cluster-listen" && i + 1 < argc) {
+            server.cluster.listen = argv[++i];
+        } else if (arg == "--worker" && i + 1 < argc) {
+            worker.coordinator = argv[++i];
+        } else if (arg == "--work-dir" && i + 1 < argc) {
+            worker.workDir = argv[++i];
+        } else if (arg == "--submit" && i + 2 < argc) {
+            submitProblem = std::atoi(argv[++i]);
+            submitPath = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    if (!packTarget.empty()) return run_pack(packTarget);
+    if (!submitPath.empty()) return submit_to_judge_server(server.socketPath, submitProblem, submitPath, batch.allTests);
+    server.cluster.token = worker.token = default_cluster_token();
+    if (!worker.coordinator.empty()) return run_cluster_worker(worker, options);
+    if (serveMode) return run_judge_server(server, options);
+    if (batchMode) return run_batch(batch, options);
+
     std::cout << "                                                  \n";
     std::cout << "   |@@@@@@@@@|        |$|            |$|          \n";
     std::cout << "   |@@|               |$|            |$|          \n";
@@ -357,6 +346,6 @@ int main() {
     std::cout << "__________________________________________________\n";
     std::cout << "Welcome to the C++ Judge (Dynamic Version)!\n";
     std::cout << "Test cases loaded from 'problems' folder\n\n";
-    run_submission_tester();
+    run_submission_tester(options);
     return 0;
 }
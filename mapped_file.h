@@ -0,0 +1,97 @@
+#pragma once
+
+// Read-only memory mapping of a whole file. The bytes are served from the
+// page cache; nothing is copied into the judge's heap.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { unmap(); }
+
+    // An empty file maps successfully to an empty view.
+    bool open(const std::filesystem::path& path, std::string& error) {
+        unmap();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::string("cannot open: ") + std::strerror(errno);
+            return false;
+        }
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            error = std::string("fstat: ") + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size > 0) {
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                error = std::string("mmap: ") + std::strerror(errno);
+                close(fd);
+                return false;
+            }
+            data_ = static_cast<const char*>(data);
+            size_ = size;
+        }
+        close(fd);
+        return true;
+    }
+
+    std::string_view view() const { return {data_, size_}; }
+
+    const char* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+    // madvise() for the pages covering [offset, offset + length), e.g.
+    // MADV_WILLNEED to read them ahead or MADV_DONTNEED to drop them from
+    // the judge's resident set (they stay in the page cache).
+    void advise(size_t offset, size_t length, int advice) const {
+        if (!data_ || offset >= size_ || length == 0) return;
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset / pageSize * pageSize;
+        size_t end = std::min(size_, offset + length);
+        madvise(const_cast<char*>(data_) + start, end - start, advice);
+    }
+
+private:
+    void unmap() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
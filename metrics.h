@@ -0,0 +1,393 @@
+#pragma once
+
+// Service metrics for the judge server: counters, HDR-style latency
+// histograms and a submission rate, exposed in the Prometheus text format
+// on a local HTTP endpoint and/or in a file that is rewritten periodically
+// (for node_exporter's textfile collector).
+//
+// Workers update metrics with relaxed atomic operations only; no lock is
+// taken on the judging path. An export reads each value on its own, so a
+// scrape taken while a submission is being recorded may see part of it.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "report.h"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "metrics need lock-free 64-bit atomics");
+
+inline constexpr size_t verdictCount = static_cast<size_t>(Verdict::CompilationError) + 1;
+
+namespace metrics_detail {
+
+// Log-linear buckets: values below 32 have a bucket each, above that every
+// power of two is split into 16 buckets, so a bucket is at most 1/16 of
+// its value wide. Values are clamped to 2^36 - 1.
+inline constexpr int linearBits = 5;
+inline constexpr int maxBits = 36;
+inline constexpr uint64_t maxValue = (uint64_t(1) << maxBits) - 1;
+inline constexpr size_t bucketCount = (maxBits - linearBits + 2) * 16;
+
+inline size_t bucket_of(uint64_t value) {
+    if (value < 32) return static_cast<size_t>(value);
+    int shift = 64 - __builtin_clzll(value) - linearBits;
+    return static_cast<size_t>(shift) * 16 + static_cast<size_t>(value >> shift);
+}
+
+// Smallest and largest value that land in `bucket`.
+inline uint64_t bucket_low(size_t bucket) {
+    if (bucket < 32) return bucket;
+    int shift = static_cast<int>(bucket / 16) - 1;
+    return static_cast<uint64_t>(bucket % 16 + 16) << shift;
+}
+
+inline uint64_t bucket_high(size_t bucket) {
+    if (bucket < 32) return bucket;
+    int shift = static_cast<int>(bucket / 16) - 1;
+    return (static_cast<uint64_t>(bucket % 16 + 17) << shift) - 1;
+}
+
+} // namespace metrics_detail
+
+// Latency distribution in microseconds; quantiles are accurate to about 6%.
+class LatencyHistogram {
+public:
+    struct Snapshot {
+        std::array<uint64_t, metrics_detail::bucketCount> counts{};
+        uint64_t count = 0;
+        uint64_t sumUs = 0;
+
+        // Middle of the bucket holding the q-quantile, NaN if empty.
+        double quantileUs(double q) const {
+            if (count == 0) return std::nan("");
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    return (metrics_detail::bucket_low(i) + metrics_detail::bucket_high(i)) / 2.0;
+                }
+            }
+            return static_cast<double>(metrics_detail::maxValue);
+        }
+    };
+
+    void record(uint64_t us) {
+        buckets_[metrics_detail::bucket_of(std::min(us, metrics_detail::maxValue))].fetch_add(
+            1, std::memory_order_relaxed);
+        sumUs_.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for (size_t i = 0; i < s.counts.size(); ++i) {
+            s.counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            s.count += s.counts[i];
+        }
+        s.sumUs = sumUs_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, metrics_detail::bucketCount> buckets_{};
+    std::atomic<uint64_t> sumUs_{0};
+};
+
+// Events per second over the last minute, from one counter per second.
+// Each slot packs its second and its count into one word, so adding is a
+// single compare-and-swap loop.
+class RateMeter {
+public:
+    static constexpr int64_t windowSeconds = 60;
+
+    void add(int64_t second) {
+        std::atomic<uint64_t>& slot = slots_[static_cast<size_t>(second) % slots_.size()];
+        const uint64_t stamp = static_cast<uint64_t>(second) << countBits;
+        uint64_t seen = slot.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            next = (seen & ~countMask) == stamp ? seen + 1 : stamp | 1;
+        } while (!slot.compare_exchange_weak(seen, next, std::memory_order_relaxed));
+    }
+
+    // Only whole seconds count, so the current one is left out.
+    double perSecond(int64_t now) const {
+        uint64_t total = 0;
+        for (const auto& slot : slots_) {
+            uint64_t value = slot.load(std::memory_order_relaxed);
+            int64_t second = static_cast<int64_t>(value >> countBits);
+            if (value != 0 && second < now && second >= now - windowSeconds) total += value & countMask;
+        }
+        return static_cast<double>(total) / windowSeconds;
+    }
+
+private:
+    static constexpr int countBits = 24;
+    static constexpr uint64_t countMask = (uint64_t(1) << countBits) - 1;
+
+    std::array<std::atomic<uint64_t>, windowSeconds + 4> slots_{};
+};
+
+// Values owned by the server itself, read when metrics are exported.
+struct ServiceGauges {
+    size_t queued = 0;
+    size_t queueCapacity = 0;
+    unsigned workers = 0;
+    unsigned busyWorkers = 0;
+    uint64_t rejected = 0;
+};
+
+class JudgeMetrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // A submission the server has answered. `compiled` is false if it never
+    // got to the compiler (unknown problem, missing file).
+    void recordSubmission(const SubmissionRecord& record, uint64_t queueUs, uint64_t judgeUs, bool compiled) {
+        submissions_[static_cast<size_t>(record.verdict)].fetch_add(1, std::memory_order_relaxed);
+        rate_.add(secondsSinceStart());
+        queueWait_.record(queueUs);
+        judgement_.record(judgeUs);
+        if (compiled && record.fromCache) {
+            cacheHits_.fetch_add(1, std::memory_order_relaxed);
+        } else if (compiled) {
+            compile_.record(static_cast<uint64_t>(record.compileMs) * 1000);
+        }
+        for (const TestRecord& test : record.tests) {
+            tests_[static_cast<size_t>(test.verdict)].fetch_add(1, std::memory_order_relaxed);
+            testRun_.record(static_cast<uint64_t>(test.wallTimeMs) * 1000);
+        }
+    }
+
+    void writePrometheus(std::ostream& out, const ServiceGauges& gauges) const {
+        const double uptime = std::chrono::duration<double>(Clock::now() - started_).count();
+        gauge(out, "judge_uptime_seconds", "Seconds since the judge server started.", uptime);
+        perVerdict(out, "judge_submissions_total", "Submissions judged, by verdict.", submissions_);
+        gauge(out, "judge_submissions_per_second", "Submissions judged per second over the last minute.",
+              rate_.perSecond(secondsSinceStart()));
+        perVerdict(out, "judge_tests_total", "Test runs reported, by verdict.", tests_);
+        counter(out, "judge_compile_cache_hits_total", "Submissions whose binary came from the compile cache.",
+                cacheHits_.load(std::memory_order_relaxed));
+        counter(out, "judge_rejected_total", "Submissions rejected because the queue was full.", gauges.rejected);
+        summary(out, "judge_compile_seconds", "Compile time of submissions not found in the compile cache.", compile_);
+        summary(out, "judge_test_run_seconds", "Wall time of a single test run.", testRun_);
+        summary(out, "judge_queue_wait_seconds", "Time a submission waited in the queue.", queueWait_);
+        summary(out, "judge_judgement_seconds", "Time from leaving the queue to the answer.", judgement_);
+        gauge(out, "judge_queue_depth", "Submissions waiting in the queue.", static_cast<double>(gauges.queued));
+        gauge(out, "judge_queue_capacity", "Queued submissions before new ones are rejected.",
+              static_cast<double>(gauges.queueCapacity));
+        gauge(out, "judge_workers", "Judging workers.", gauges.workers);
+        gauge(out, "judge_workers_active", "Workers currently judging a submission.", gauges.busyWorkers);
+    }
+
+private:
+    int64_t secondsSinceStart() const {
+        return std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - started_).count();
+    }
+
+    static void header(std::ostream& out, const char* name, const char* help, const char* type) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+    static void gauge(std::ostream& out, const char* name, const char* help, double value) {
+        header(out, name, help, "gauge");
+        out << name << " " << value << "\n";
+    }
+
+    static void counter(std::ostream& out, const char* name, const char* help, uint64_t value) {
+        header(out, name, help, "counter");
+        out << name << " " << value << "\n";
+    }
+
+    static void perVerdict(std::ostream& out, const char* name, const char* help,
+                           const std::array<std::atomic<uint64_t>, verdictCount>& counts) {
+        header(out, name, help, "counter");
+        for (size_t v = 0; v < verdictCount; ++v) {
+            out << name << "{verdict=\"" << verdict_code(static_cast<Verdict>(v)) << "\"} "
+                << counts[v].load(std::memory_order_relaxed) << "\n";
+        }
+    }
+
+    static void summary(std::ostream& out, const char* name, const char* help, const LatencyHistogram& histogram) {
+        header(out, name, help, "summary");
+        LatencyHistogram::Snapshot s = histogram.snapshot();
+        for (const char* q : {"0.5", "0.9", "0.99", "0.999"}) {
+            double us = s.quantileUs(std::atof(q));
+            out << name << "{quantile=\"" << q << "\"} ";
+            if (std::isnan(us)) {
+                out << "NaN\n";
+            } else {
+                out << us / 1e6 << "\n";
+            }
+        }
+        out << name << "_sum " << s.sumUs / 1e6 << "\n" << name << "_count " << s.count << "\n";
+    }
+
+    const Clock::time_point started_ = Clock::now();
+    std::array<std::atomic<uint64_t>, verdictCount> submissions_{};
+    std::array<std::atomic<uint64_t>, verdictCount> tests_{};
+    std::atomic<uint64_t> cacheHits_{0};
+    RateMeter rate_;
+    LatencyHistogram compile_, testRun_, queueWait_, judgement_;
+};
+
+struct MetricsOptions {
+    int httpPort = 0;                  // serve GET /metrics on 127.0.0.1, 0 = off
+    std::string filePath;              // rewrite this file, empty = off
+    long fileIntervalMs = 10000;
+};
+
+// Background thread that serves and/or writes the metrics text produced by
+// `render`. Scrapes are answered one at a time; a client gets a second to
+// send its request.
+class MetricsExporter {
+public:
+    using Render = std::function<std::string()>;
+
+    MetricsExporter(MetricsOptions options, Render render)
+        : options_(std::move(options)), render_(std::move(render)) {}
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    ~MetricsExporter() { stop(); }
+
+    bool start(std::string& error) {
+        if (options_.httpPort > 0) {
+            listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int one = 1;
+            setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(options_.httpPort));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (listenFd_ < 0 || bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+                listen(listenFd_, 16) != 0) {
+                error = "cannot listen on 127.0.0.1:" + std::to_string(options_.httpPort) + ": " + std::strerror(errno);
+                if (listenFd_ >= 0) close(listenFd_);
+                listenFd_ = -1;
+                return false;
+            }
+        }
+        if (listenFd_ < 0 && options_.filePath.empty()) return true;
+        if (pipe2(stopPipe_, O_CLOEXEC) != 0) {
+            error = std::string("pipe: ") + std::strerror(errno);
+            return false;
+        }
+        thread_ = std::thread([this] { loop(); });
+        return true;
+    }
+
+    // Writes the file one last time, so it reflects the final counts.
+    void stop() {
+        if (!thread_.joinable()) return;
+        char byte = 1;
+        (void)!write(stopPipe_[1], &byte, 1);
+        thread_.join();
+        writeFile();
+        for (int fd : {listenFd_, stopPipe_[0], stopPipe_[1]}) {
+            if (fd >= 0) close(fd);
+        }
+        listenFd_ = stopPipe_[0] = stopPipe_[1] = -1;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void loop() {
+        Clock::time_point nextWrite = Clock::now();
+        while (true) {
+            if (!options_.filePath.empty() && Clock::now() >= nextWrite) {
+                writeFile();
+                nextWrite = Clock::now() + std::chrono::milliseconds(options_.fileIntervalMs);
+            }
+            int timeout = -1;
+            if (!options_.filePath.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(nextWrite - Clock::now()).count();
+                timeout = static_cast<int>(std::max<long long>(0, left));
+            }
+            pollfd fds[2] = {{stopPipe_[0], POLLIN, 0}, {listenFd_, POLLIN, 0}};
+            if (poll(fds, listenFd_ >= 0 ? 2 : 1, timeout) < 0 && errno != EINTR) return;
+            if (fds[0].revents) return;
+            if (listenFd_ >= 0 && (fds[1].revents & POLLIN)) {
+                int client = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0) {
+                    serve(client);
+                    close(client);
+                }
+            }
+        }
+    }
+
+    void serve(int client) {
+        std::string request;
+        char buf[1024];
+        const Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            pollfd fd{client, POLLIN, 0};
+            if (left <= 0 || poll(&fd, 1, static_cast<int>(left)) <= 0) return;
+            ssize_t n = recv(client, buf, sizeof(buf), 0);
+            if (n <= 0) return;
+            request.append(buf, static_cast<size_t>(n));
+        }
+        std::string status = "200 OK", type = "text/plain; version=0.0.4", body;
+        if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+            body = render_();
+        } else {
+            status = "404 Not Found";
+            type = "text/plain";
+            body = "not found\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+                               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" +
+                               body;
+        std::string_view data = response;
+        while (!data.empty()) {
+            ssize_t n = send(client, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+
+    // Written next to the target and renamed, so readers never see half a file.
+    void writeFile() {
+        if (options_.filePath.empty()) return;
+        std::string tmp = options_.filePath + ".tmp";
+        std::string text = render_();
+        bool ok = false;
+        if (FILE* file = std::fopen(tmp.c_str(), "w")) {
+            ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+            ok = std::fclose(file) == 0 && ok;
+        }
+        if (!ok || std::rename(tmp.c_str(), options_.filePath.c_str()) != 0) {
+            if (!warned_) std::cerr << "Warning: cannot write metrics to " << options_.filePath << "\n";
+            warned_ = true;
+        }
+    }
+
+    MetricsOptions options_;
+    Render render_;
+    int listenFd_ = -1;
+    int stopPipe_[2] = {-1, -1};
+    bool warned_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+// Precompiled headers for the submission compile step. Most submissions
+// start with the same block of system includes (usually <bits/stdc++.h>),
+// and parsing those dominates the compile. For such a block the judge
+// builds a header containing exactly those includes, precompiles it once per
+// flag profile, and force-includes it (-include) into the submission. The
+// submission's own includes then hit their include guards, so the program
+// sees the same declarations in the same order as without the PCH.
+//
+// Layout: <dir>/<key>/judge_pch.h, judge_pch.h.gch and meta, where key is
+// the SHA-256 of the compiler identity, the flags and the include block.
+// <bits/stdc++.h> is precompiled the first time it is seen; other include
+// blocks once they have been seen twice. At most `maxEntries` PCHs are kept.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "compile_cache.h"
+#include "process_runner.h"
+#include "sha256.h"
+
+// Default location: next to the compile cache.
+inline std::filesystem::path default_pch_dir() {
+    return default_compile_cache_dir().parent_path() / "pch";
+}
+
+// System headers included at the very top of `source`, in order. Empty if
+// anything other than comments, blank lines and #include <...> comes first.
+inline std::vector<std::string> leading_system_includes(std::string_view source) {
+    std::vector<std::string> headers;
+    size_t pos = 0;
+    bool inBlockComment = false;
+    while (pos < source.size()) {
+        size_t end = source.find('\n', pos);
+        if (end == std::string_view::npos) end = source.size();
+        std::string_view line = source.substr(pos, end - pos);
+        pos = end + 1;
+
+        // Strip comments from the line.
+        std::string code;
+        for (size_t i = 0; i < line.size(); ++i) {
+            if (inBlockComment) {
+                if (line.compare(i, 2, "*/") == 0) {
+                    inBlockComment = false;
+                    ++i;
+                }
+            } else if (line.compare(i, 2, "/*") == 0) {
+                inBlockComment = true;
+                ++i;
+            } else if (line.compare(i, 2, "//") == 0) {
+                break;
+            } else {
+                code.push_back(line[i]);
+            }
+        }
+
+        size_t first = code.find_first_not_of(" \t\r");
+        if (first == std::string::npos) continue;
+        std::string_view rest = std::string_view(code).substr(first);
+        if (rest[0] != '#') break;
+        rest.remove_prefix(1);
+        rest.remove_prefix(std::min(rest.find_first_not_of(" \t"), rest.size()));
+        if (rest.compare(0, 7, "include") != 0) break;
+        rest.remove_prefix(7);
+        rest.remove_prefix(std::min(rest.find_first_not_of(" \t"), rest.size()));
+        size_t close = rest.find('>');
+        if (rest.empty() || rest[0] != '<' || close == std::string_view::npos) break;
+        if (rest.find_first_not_of(" \t\r", close + 1) != std::string_view::npos) break;
+        headers.emplace_back(rest.substr(1, close - 1));
+    }
+    return headers;
+}
+
+struct PrecompiledHeader {
+    std::string header;          // pass as -include <header>
+    std::string description;     // e.g. "<bits/stdc++.h>"
+    long parseMs = 0;            // compiling the include block from source
+    long loadMs = 0;             // the same with the PCH
+    bool builtNow = false;       // built for this submission
+    CacheLease lease;            // keeps the PCH from being evicted
+};
+
+class PchStore {
+public:
+    PchStore(std::filesystem::path dir, size_t maxEntries) : dir_(std::move(dir)), maxEntries_(maxEntries) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        usable_ = !ec && access(dir_.c_str(), W_OK) == 0;
+    }
+
+    bool usable() const { return usable_; }
+
+    // Returns a PCH matching the submission's include block, building it if
+    // the block is common enough. std::nullopt means compile without one.
+    std::optional<PrecompiledHeader> prepare(const std::string& compiler, const std::vector<std::string>& flags,
+                                             std::string_view source) {
+        if (!usable_) return std::nullopt;
+        std::vector<std::string> headers = leading_system_includes(source);
+        if (headers.empty()) return std::nullopt;
+
+        std::string text;
+        std::string description;
+        for (const auto& h : headers) {
+            text += "#include <" + h + ">\n";
+            description += (description.empty() ? "<" : ", <") + h + ">";
+        }
+
+        static const char version[] = "cpp-judge-pch-v1";
+        Sha256 hash;
+        hash.update(version, sizeof(version));
+        std::string identity = compiler_identity(compiler);
+        hash.update(identity.data(), identity.size() + 1);
+        for (const auto& flag : flags) hash.update(flag.data(), flag.size() + 1);
+        hash.update("", 1);
+        hash.update(text);
+        std::string key = hash.hexDigest();
+
+        if (auto pch = open(key, description)) return pch;
+
+        bool common = headers.size() == 1 && headers[0] == "bits/stdc++.h";
+        if (!common && recordSighting(key) < 2) {
+            evict();
+            return std::nullopt;
+        }
+        if (!build(key, compiler, flags, text)) return std::nullopt;
+        auto pch = open(key, description);
+        if (pch) pch->builtNow = true;
+        evict();
+        return pch;
+    }
+
+private:
+    std::optional<PrecompiledHeader> open(const std::string& key, const std::string& description) const {
+        std::filesystem::path entry = dir_ / key;
+        std::filesystem::path gch = entry / "judge_pch.h.gch";
+        int fd = ::open(gch.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+        if (flock(fd, LOCK_SH) != 0 || access(gch.c_str(), F_OK) != 0) {
+            close(fd);
+            return std::nullopt;
+        }
+        std::error_code ec;
+        std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);
+
+        PrecompiledHeader pch{(entry / "judge_pch.h").string(), description, 0, 0, false, CacheLease(gch, fd)};
+        std::ifstream meta(entry / "meta");
+        meta >> pch.parseMs >> pch.loadMs;
+        return pch;
+    }
+
+    // Counts how often an include block has been seen; returns the new count.
+    int recordSighting(const std::string& key) const {
+        std::filesystem::path seen = dir_ / (".seen-" + key);
+        int count = 0;
+        {
+            std::ifstream in(seen);
+            in >> count;
+        }
+        std::ofstream(seen) << ++count;
+        return count;
+    }
+
+    bool build(const std::string& key, const std::string& compiler, const std::vector<std::string>& flags,
+               const std::string& text) const {
+        static std::atomic<unsigned> counter{0};
+        std::filesystem::path staging = dir_ / (".tmp-" + std::to_string(getpid()) + "-" + std::to_string(counter++));
+        std::error_code ec;
+        std::filesystem::create_directories(staging, ec);
+        if (ec) return false;
+        std::filesystem::path header = staging / "judge_pch.h";
+        std::ofstream(header) << text;
+
+        using Clock = std::chrono::steady_clock;
+        auto elapsedMs = [](Clock::time_point since) {
+            return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count());
+        };
+
+        RunOptions precompile;
+        precompile.argv = {compiler};
+        precompile.argv.insert(precompile.argv.end(), flags.begin(), flags.end());
+        precompile.argv.insert(precompile.argv.end(),
+                               {"-x", "c++-header", header.string(), "-o", header.string() + ".gch"});
+        auto start = Clock::now();
+        RunResult built = run_process(precompile);
+        long parseMs = elapsedMs(start);
+
+        bool ok = built.started && built.exitCode == 0;
+        long loadMs = 0;
+        if (ok) {
+            // Cost of the same include block through the PCH, for reporting.
+            RunOptions probe;
+            probe.argv = {compiler};
+            probe.argv.insert(probe.argv.end(), flags.begin(), flags.end());
+            probe.argv.insert(probe.argv.end(),
+                              {"-include", header.string(), "-Winvalid-pch", "-fsyntax-only", "-x", "c++", "/dev/null"});
+            start = Clock::now();
+            RunResult probed = run_process(probe);
+            loadMs = elapsedMs(start);
+            ok = probed.started && probed.exitCode == 0 && probed.err.find("judge_pch.h.gch") == std::string::npos;
+        }
+        if (ok) {
+            std::ofstream(staging / "meta") << parseMs << " " << loadMs << "\n";
+            std::filesystem::rename(staging, dir_ / key, ec);
+            std::filesystem::remove(dir_ / (".seen-" + key), ec);
+        }
+        // Also covers losing a race against another judge building the same key.
+        std::filesystem::remove_all(staging, ec);
+        return ok;
+    }
+
+    // Keeps the most recently used PCHs, and the sightings of the include
+    // blocks seen most recently that have no PCH yet.
+    void evict() const {
+        struct Entry {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+        };
+        auto newestFirst = [](const Entry& a, const Entry& b) { return a.used > b.used; };
+        std::vector<Entry> entries, sightings;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind(".seen-", 0) == 0) sightings.push_back({entry.path(), entry.last_write_time(ec)});
+            if (name.empty() || name[0] == '.' || !entry.is_directory(ec)) continue;
+            entries.push_back({entry.path(), entry.last_write_time(ec)});
+        }
+        const size_t maxSightings = maxEntries_ * sightingsPerEntry;
+        if (sightings.size() > maxSightings) {
+            std::sort(sightings.begin(), sightings.end(), newestFirst);
+            for (size_t i = maxSightings; i < sightings.size(); ++i) std::filesystem::remove(sightings[i].path, ec);
+        }
+        if (entries.size() <= maxEntries_) return;
+
+        std::sort(entries.begin(), entries.end(), newestFirst);
+        for (size_t i = maxEntries_; i < entries.size(); ++i) {
+            std::filesystem::path gch = entries[i].path / "judge_pch.h.gch";
+            int fd = ::open(gch.c_str(), O_RDONLY | O_CLOEXEC);
+            // PCHs that are in use by a running compile are skipped.
+            if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+                close(fd);
+                continue;
+            }
+            std::filesystem::remove_all(entries[i].path, ec);
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // Most include blocks are seen once and never again
+    static constexpr size_t sightingsPerEntry = 8;
+
+    std::filesystem::path dir_;
+    size_t maxEntries_;
+    bool usable_ = false;
+};
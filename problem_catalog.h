@@ -0,0 +1,347 @@
+#pragma once
+
+// In-memory catalog of the problems/ folder: ID, title, limits and test
+// count of every problem. It is built once, saved as a compact index in
+// problems/.catalog and on the next start only problems whose info.json,
+// tests/ folder or tests.pack changed are read again. With watch() the
+// catalog follows changes through inotify, one problem at a time, and
+// reports which problem changed so that its cached data can be dropped.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "problem_pack.h"
+#include "problems.h"
+#include "process_runner.h"
+
+struct CatalogEntry {
+    int id = 0;
+    std::string title;
+    std::string timeLimit;
+    std::string memoryLimit;
+    size_t testCount = 0;
+    // Modification times (ns) the entry was built from, 0 = missing.
+    int64_t infoStamp = 0;
+    int64_t testsStamp = 0;
+    int64_t packStamp = 0;
+};
+
+namespace catalog_detail {
+
+inline constexpr const char* indexHeader = "cpp-judge-catalog 1";
+
+inline int64_t stamp(const std::filesystem::path& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+inline bool numeric(const std::string& name) {
+    return !name.empty() && name.size() < 10 && std::all_of(name.begin(), name.end(), ::isdigit);
+}
+
+// Tabs and newlines would break the index format; titles never need them.
+inline std::string flatten(std::string text) {
+    std::replace_if(text.begin(), text.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    return text;
+}
+
+} // namespace catalog_detail
+
+class ProblemCatalog {
+public:
+    using ChangeListener = std::function<void(int problemID)>;
+
+    ProblemCatalog() : root_(getProblemsPath()), indexPath_(root_ / ".catalog") {}
+
+    ProblemCatalog(const ProblemCatalog&) = delete;
+    ProblemCatalog& operator=(const ProblemCatalog&) = delete;
+
+    ~ProblemCatalog() { stopWatching(); }
+
+    // Reads the saved index and brings it up to date: problems that were
+    // added, removed or changed since it was written are rescanned. Saves
+    // the index again if anything changed.
+    void load() {
+        std::map<int, CatalogEntry> saved = readIndex();
+        std::map<int, CatalogEntry> entries;
+        bool changed = false;
+        std::error_code ec;
+        for (const auto& dirEntry : std::filesystem::directory_iterator(root_, ec)) {
+            std::string name = dirEntry.path().filename().string();
+            if (!catalog_detail::numeric(name) || !dirEntry.is_directory(ec)) continue;
+            int id = std::stoi(name);
+            auto it = saved.find(id);
+            if (it != saved.end() && upToDate(it->second)) {
+                entries.emplace(id, std::move(it->second));
+            } else {
+                entries.emplace(id, scan(id));
+                changed = true;
+            }
+        }
+        changed = changed || entries.size() != saved.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_ = std::move(entries);
+        }
+        if (changed) save();
+    }
+
+    std::vector<int> ids() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<int> ids;
+        ids.reserve(entries_.size());
+        for (const auto& [id, entry] : entries_) ids.push_back(id);
+        return ids;
+    }
+
+    std::optional<CatalogEntry> find(int problemID) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(problemID);
+        if (it == entries_.end()) return std::nullopt;
+        return it->second;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    // Starts following problems/ with inotify on a background thread.
+    // `onChange` is called (from that thread) for every problem that was
+    // added, removed or edited, once its catalog entry is up to date.
+    // Returns false if inotify is not available.
+    bool watch(ChangeListener onChange) {
+        if (watcher_.joinable()) return true;
+        inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd_ < 0 || pipe2(stopPipe_, O_CLOEXEC) != 0) {
+            closeWatchFds();
+            return false;
+        }
+        if (!addWatch(root_, rootWatch)) {
+            closeWatchFds();
+            return false;
+        }
+        for (int id : ids()) watchProblem(id);
+        listener_ = std::move(onChange);
+        watcher_ = std::thread([this] { watchLoop(); });
+        return true;
+    }
+
+    void stopWatching() {
+        if (!watcher_.joinable()) return;
+        char byte = 1;
+        (void)!write(stopPipe_[1], &byte, 1);
+        watcher_.join();
+        closeWatchFds();
+    }
+
+private:
+    static constexpr int rootWatch = -1;
+    static constexpr uint32_t problemEvents =
+        IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+    std::filesystem::path problemDir(int id) const { return root_ / std::to_string(id); }
+
+    bool upToDate(const CatalogEntry& entry) const {
+        std::filesystem::path dir = problemDir(entry.id);
+        return entry.infoStamp == catalog_detail::stamp(dir / "info.json") &&
+               entry.testsStamp == catalog_detail::stamp(dir / "tests") &&
+               entry.packStamp == catalog_detail::stamp(dir / "tests.pack");
+    }
+
+    CatalogEntry scan(int id) const {
+        std::filesystem::path dir = problemDir(id);
+        CatalogEntry entry;
+        entry.id = id;
+        // Stamps first: a change made while scanning is picked up next time.
+        entry.infoStamp = catalog_detail::stamp(dir / "info.json");
+        entry.testsStamp = catalog_detail::stamp(dir / "tests");
+        entry.packStamp = catalog_detail::stamp(dir / "tests.pack");
+        ProblemInfo info = loadProblemInfo(id);
+        entry.title = catalog_detail::flatten(info.title);
+        entry.timeLimit = catalog_detail::flatten(info.timeLimit);
+        entry.memoryLimit = catalog_detail::flatten(info.memoryLimit);
+        if (entry.testsStamp) {
+            entry.testCount = listTestSources(id).size();
+        } else if (entry.packStamp) {
+            std::string error;
+            if (auto pack = ProblemPack::open(dir / "tests.pack", error)) entry.testCount = pack->size();
+        }
+        return entry;
+    }
+
+    // One line per problem: stamps and counts, then the text fields
+    // separated by tabs.
+    std::map<int, CatalogEntry> readIndex() const {
+        std::map<int, CatalogEntry> entries;
+        std::ifstream in(indexPath_);
+        std::string line;
+        if (!std::getline(in, line) || line != catalog_detail::indexHeader) return entries;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            CatalogEntry entry;
+            if (!(fields >> entry.id >> entry.infoStamp >> entry.testsStamp >> entry.packStamp >> entry.testCount) ||
+                fields.get() != '\t' || !std::getline(fields, entry.title, '\t') ||
+                !std::getline(fields, entry.timeLimit, '\t') || !std::getline(fields, entry.memoryLimit)) {
+                return {};
+            }
+            entries.emplace(entry.id, std::move(entry));
+        }
+        return entries;
+    }
+
+    // Written to a temporary file and renamed, so readers never see half an
+    // index. A read-only problems/ folder just means no index.
+    void save() const {
+        std::ostringstream out;
+        out << catalog_detail::indexHeader << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& [id, e] : entries_) {
+                out << id << ' ' << e.infoStamp << ' ' << e.testsStamp << ' ' << e.packStamp << ' ' << e.testCount
+                    << '\t' << e.title << '\t' << e.timeLimit << '\t' << e.memoryLimit << '\n';
+            }
+        }
+        std::filesystem::path temp = indexPath_;
+        temp += "." + std::to_string(getpid()) + ".tmp";
+        std::ofstream file(temp, std::ios::binary);
+        if (!file.is_open()) return;
+        file << out.str();
+        file.close();
+        std::error_code ec;
+        if (file) std::filesystem::rename(temp, indexPath_, ec);
+        if (!file || ec) std::filesystem::remove(temp, ec);
+    }
+
+    bool addWatch(const std::filesystem::path& path, int id) {
+        uint32_t events = problemEvents;
+        if (id == rootWatch) events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+        int wd = inotify_add_watch(inotifyFd_, path.c_str(), events);
+        if (wd < 0) return false;
+        watches_[wd] = id;
+        return true;
+    }
+
+    // The problem folder itself (info.json, tests.pack) and its tests/.
+    void watchProblem(int id) {
+        addWatch(problemDir(id), id);
+        addWatch(problemDir(id) / "tests", id);
+    }
+
+    void refresh(int id) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(problemDir(id), ec)) {
+            CatalogEntry entry = scan(id);
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_[id] = std::move(entry);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.erase(id);
+        }
+    }
+
+    void watchLoop() {
+        alignas(inotify_event) char buf[16384];
+        while (true) {
+            pollfd fds[2] = {{inotifyFd_, POLLIN, 0}, {stopPipe_[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) return;
+            if (fds[1].revents) return;
+            if (!fds[0].revents) continue;
+
+            // Editors and copies produce bursts of events; collect them for
+            // a moment so that each problem is rescanned once.
+            std::set<int> changed;
+            bool overflowed = false;
+            int timeout = 50;
+            while (true) {
+                ssize_t n = read(inotifyFd_, buf, sizeof(buf));
+                if (n <= 0) {
+                    pollfd wait = {inotifyFd_, POLLIN, 0};
+                    if (poll(&wait, 1, timeout) <= 0) break;
+                    continue;
+                }
+                for (char* p = buf; p < buf + n;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                    p += sizeof(inotify_event) + event->len;
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        overflowed = true;
+                        continue;
+                    }
+                    auto it = watches_.find(event->wd);
+                    if (event->mask & IN_IGNORED) {
+                        if (it != watches_.end()) watches_.erase(it);
+                        continue;
+                    }
+                    if (it == watches_.end()) continue;
+                    std::string name = event->len ? event->name : "";
+                    if (it->second == rootWatch) {
+                        // problems/ itself: a problem folder came or went.
+                        if (catalog_detail::numeric(name)) changed.insert(std::stoi(name));
+                    } else {
+                        changed.insert(it->second);
+                    }
+                }
+            }
+
+            if (overflowed) {
+                // Events were dropped: rescan everything and report every
+                // problem, present before or after, as changed.
+                std::vector<int> before = ids();
+                changed.insert(before.begin(), before.end());
+                load();
+                addWatch(root_, rootWatch);
+                for (int id : ids()) {
+                    watchProblem(id);
+                    changed.insert(id);
+                }
+            } else {
+                for (int id : changed) {
+                    // Cheap when already watched: inotify returns the same wd.
+                    watchProblem(id);
+                    refresh(id);
+                }
+                if (changed.empty()) continue;
+                save();
+            }
+            if (listener_) {
+                for (int id : changed) listener_(id);
+            }
+        }
+    }
+
+    void closeWatchFds() {
+        process_detail::close_fd(inotifyFd_);
+        process_detail::close_fd(stopPipe_[0]);
+        process_detail::close_fd(stopPipe_[1]);
+        watches_.clear();
+    }
+
+    std::filesystem::path root_;
+    std::filesystem::path indexPath_;
+    mutable std::mutex mutex_;
+    std::map<int, CatalogEntry> entries_;
+
+    int inotifyFd_ = -1;
+    int stopPipe_[2] = {-1, -1};
+    std::map<int, int> watches_;      // inotify watch -> problem ID or rootWatch
+    ChangeListener listener_;
+    std::thread watcher_;
+};
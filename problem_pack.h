@@ -0,0 +1,228 @@
+#pragma once
+
+// Problem packs: all test cases of a problem in one file that is mapped
+// into memory and used as is, with no parsing.
+//
+// Layout (little-endian):
+//   header   "CJPACK\0\0", uint32 version, uint32 test count
+//   index    per test: uint64 input offset, uint64 input size,
+//                      uint64 output offset, uint64 output size
+//   blobs    raw input and expected output bytes
+// Offsets are from the start of the file. Tests are in judging order.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include "mapped_file.h"
+#include "problems.h"
+
+inline constexpr char problemPackMagic[8] = {'C', 'J', 'P', 'A', 'C', 'K', '\0', '\0'};
+inline constexpr uint32_t problemPackVersion = 1;
+
+inline std::filesystem::path problemPackPath(int problemID,
+                                             const std::filesystem::path& problemsDir = getProblemsPath()) {
+    return problemsDir / std::to_string(problemID) / "tests.pack";
+}
+
+// Whether anything in `testsDir` changed after the pack was written. The
+// folder's own time only moves when tests are added, removed or renamed,
+// so the files are checked too for tests edited in place.
+inline bool problemPackIsStale(const std::filesystem::path& packPath, const std::filesystem::path& testsDir) {
+    std::error_code ec;
+    auto packTime = std::filesystem::last_write_time(packPath, ec);
+    if (ec) return true;
+    auto newest = std::filesystem::last_write_time(testsDir, ec);
+    if (ec) return false;
+    for (std::filesystem::directory_iterator it(testsDir, ec), end; !ec && it != end; it.increment(ec)) {
+        auto time = it->last_write_time(ec);
+        if (!ec && time > newest) newest = time;
+        ec.clear();
+    }
+    return newest > packTime;
+}
+
+namespace pack_detail {
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+};
+
+struct IndexEntry {
+    uint64_t inputOffset;
+    uint64_t inputSize;
+    uint64_t outputOffset;
+    uint64_t outputSize;
+};
+
+static_assert(sizeof(Header) == 16 && sizeof(IndexEntry) == 32, "pack layout must not have padding");
+
+} // namespace pack_detail
+
+// A validated pack file, mapped read-only. The views returned by test() stay
+// valid as long as the pack is alive.
+class ProblemPack {
+public:
+    static std::unique_ptr<ProblemPack> open(const std::filesystem::path& path, std::string& error) {
+        std::unique_ptr<ProblemPack> pack(new ProblemPack());
+        if (!pack->file_.open(path, error)) return nullptr;
+        if (pack->file_.size() < sizeof(pack_detail::Header)) {
+            error = "file too small";
+            return nullptr;
+        }
+        pack->data_ = pack->file_.data();
+        pack->size_ = pack->file_.size();
+        if (!pack->validate(error)) return nullptr;
+        return pack;
+    }
+
+    ProblemPack(const ProblemPack&) = delete;
+    ProblemPack& operator=(const ProblemPack&) = delete;
+
+    size_t size() const { return count_; }
+
+    TestData test(size_t index) const {
+        pack_detail::IndexEntry entry = indexEntry(index);
+        return {{data_ + entry.inputOffset, static_cast<size_t>(entry.inputSize)},
+                {data_ + entry.outputOffset, static_cast<size_t>(entry.outputSize)},
+                {},
+                {}};
+    }
+
+    // Starts reading a test's pages in the background.
+    void prefetch(size_t index) const { advise(index, MADV_WILLNEED); }
+
+    // Drops a finished test's pages from the judge's memory. Harmless if
+    // another submission still reads them: they fault back in from the
+    // page cache.
+    void release(size_t index) const { advise(index, MADV_DONTNEED); }
+
+private:
+    ProblemPack() = default;
+
+    pack_detail::IndexEntry indexEntry(size_t index) const {
+        pack_detail::IndexEntry entry;
+        std::memcpy(&entry, data_ + sizeof(pack_detail::Header) + index * sizeof(entry), sizeof(entry));
+        return entry;
+    }
+
+    // A test's input and output are stored next to each other.
+    void advise(size_t index, int advice) const {
+        pack_detail::IndexEntry entry = indexEntry(index);
+        file_.advise(entry.inputOffset, entry.inputSize, advice);
+        file_.advise(entry.outputOffset, entry.outputSize, advice);
+    }
+
+    // Checks the header and that every blob lies inside the file, so
+    // test() never has to.
+    bool validate(std::string& error) {
+        pack_detail::Header header;
+        std::memcpy(&header, data_, sizeof(header));
+        if (std::memcmp(header.magic, problemPackMagic, sizeof(header.magic)) != 0) {
+            error = "not a problem pack";
+            return false;
+        }
+        if (header.version != problemPackVersion) {
+            error = "unsupported pack version " + std::to_string(header.version);
+            return false;
+        }
+        uint64_t indexEnd = sizeof(header) + uint64_t(header.count) * sizeof(pack_detail::IndexEntry);
+        if (indexEnd > size_) {
+            error = "truncated index";
+            return false;
+        }
+        count_ = header.count;
+        for (size_t i = 0; i < count_; ++i) {
+            pack_detail::IndexEntry entry;
+            std::memcpy(&entry, data_ + sizeof(header) + i * sizeof(entry), sizeof(entry));
+            if (entry.inputOffset > size_ || entry.inputSize > size_ - entry.inputOffset ||
+                entry.outputOffset > size_ || entry.outputSize > size_ - entry.outputOffset) {
+                error = "test " + std::to_string(i + 1) + " lies outside the file";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    MappedFile file_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t count_ = 0;
+};
+
+// Writes the tests of `sources` as a pack, one test in memory at a time:
+// the index is written last, once the blob offsets are known. The file is
+// written next to `path` and renamed into place, so a judge loading the
+// pack never sees a partial file.
+inline bool writeProblemPack(const std::filesystem::path& path, const std::vector<TestSource>& sources,
+                             std::string& error) {
+    pack_detail::Header header{};
+    std::memcpy(header.magic, problemPackMagic, sizeof(header.magic));
+    header.version = problemPackVersion;
+
+    std::vector<pack_detail::IndexEntry> index;
+    index.reserve(sources.size());
+    std::filesystem::path tmp = path;
+    tmp += ".tmp-" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        // Room for the header and the largest possible index.
+        uint64_t offset = sizeof(header) + sources.size() * sizeof(pack_detail::IndexEntry);
+        out.seekp(static_cast<std::streamoff>(offset));
+        TestCase test;
+        std::string buffer, loadError;
+        for (const TestSource& source : sources) {
+            if (!loadTestSource(source, test, buffer, loadError)) {
+                std::cerr << "Warning: skipping " << (source.raw() ? source.input : source.json).string() << ": "
+                          << loadError << "\n";
+                continue;
+            }
+            pack_detail::IndexEntry& entry = index.emplace_back();
+            entry.inputOffset = offset;
+            entry.inputSize = test.input.size();
+            entry.outputOffset = offset + test.input.size();
+            entry.outputSize = test.expected_output.size();
+            offset += test.input.size() + test.expected_output.size();
+            out.write(test.input.data(), static_cast<std::streamsize>(test.input.size()));
+            out.write(test.expected_output.data(), static_cast<std::streamsize>(test.expected_output.size()));
+        }
+        // Skipped tests leave a gap after the index; offsets stay absolute.
+        header.count = static_cast<uint32_t>(index.size());
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()),
+                  static_cast<std::streamsize>(index.size() * sizeof(pack_detail::IndexEntry)));
+        if (!out || index.empty()) {
+            error = index.empty() ? "no test cases" : "cannot write " + tmp.string();
+            out.close();
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        error = "cannot rename " + tmp.string() + ": " + ec.message();
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Converts the tests in problems/<id>/tests/ into problems/<id>/tests.pack.
+inline bool packProblem(int problemID, std::string& error) {
+    std::vector<TestSource> sources = listTestSources(problemID);
+    if (sources.empty()) {
+        error = "no test cases";
+        return false;
+    }
+    return writeProblemPack(problemPackPath(problemID), sources, error);
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+// Problem data: metadata from problems/<id>/info.json and test cases from
+// problems/<id>/tests/*.json, found next to the judge binary.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "comparator.h"
+#include "json_reader.h"
+#include "trace.h"
+
+// Directory containing the judge binary; bundled data lives next to it.
+inline std::filesystem::path getJudgeDir() {
+    std::error_code ec;
+    std::filesystem::path judgePath = std::filesystem::read_symlink("/proc/self/exe", ec);
+    if (ec) return std::filesystem::current_path();
+    return judgePath.parent_path();
+}
+
+inline std::string getProblemsPath() {
+    std::filesystem::path problemsPath = getJudgeDir() / "problems";
+    return problemsPath.string();
+}
+
+struct TestCase {
+    std::string input;
+    std::string expected_output;
+};
+
+// A test case wherever its bytes live: in a TestCase, in a mapped pack, or
+// in raw .in/.out files that are only opened when the test runs.
+struct TestData {
+    std::string_view input;
+    std::string_view expected_output;
+    std::string_view inputPath;      // set for raw tests, instead of input
+    std::string_view outputPath;     // set for raw tests, instead of expected_output
+
+    bool fromFiles() const { return !inputPath.empty(); }
+};
+
+struct ProblemInfo {
+    int id;
+    std::string title;
+    std::string timeLimit;
+    std::string memoryLimit;
+    std::string outputLimit;
+    long timeLimitMs = 1000;                       // parsed from timeLimit
+    long long memoryLimitBytes = 256LL << 20;      // parsed from memoryLimit
+    long long outputLimitBytes = 64LL << 20;       // parsed from outputLimit
+    std::string compareMode;
+    CompareOptions compare;                        // parsed from compareMode
+    std::string checker;                           // checker source, relative to the problem folder
+    std::string checkerMode;                       // "testlib" or "persistent"
+    std::string interactor;                        // interactor source for interactive problems
+};
+
+// Splits "1.5 seconds" into 1.5 and "seconds" (unit lowercased).
+inline bool splitQuantity(const std::string& text, double& value, std::string& unit) {
+    std::istringstream in(text);
+    if (!(in >> value) || value <= 0) return false;
+    in >> unit;
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+    return true;
+}
+
+// "1 second", "2 seconds", "1.5 s", "500 ms" -> milliseconds, 0 if invalid
+inline long parseTimeLimitMs(const std::string& text) {
+    double value;
+    std::string unit;
+    if (!splitQuantity(text, value, unit)) return 0;
+    if (unit.rfind("ms", 0) == 0 || unit.rfind("milli", 0) == 0) return static_cast<long>(value);
+    if (unit.empty() || unit[0] == 's') return static_cast<long>(value * 1000);
+    return 0;
+}
+
+// "256 megabytes", "64 MB", "1 gigabyte", "512 KB" -> bytes, 0 if invalid
+inline long long parseMemoryLimitBytes(const std::string& text) {
+    double value;
+    std::string unit;
+    if (!splitQuantity(text, value, unit)) return 0;
+    if (unit.empty() || unit[0] == 'm') return static_cast<long long>(value * (1LL << 20));
+    if (unit[0] == 'k') return static_cast<long long>(value * (1LL << 10));
+    if (unit[0] == 'g') return static_cast<long long>(value * (1LL << 30));
+    return 0;
+}
+
+// Reads a whole file into `out` with a single allocation.
+inline bool readFile(const std::filesystem::path& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0) return false;
+    file.seekg(0, std::ios::beg);
+    out.resize(static_cast<size_t>(size));
+    file.read(out.data(), size);
+    out.resize(static_cast<size_t>(file.gcount()));
+    return true;
+}
+
+// Fills `info` from the top-level fields of info.json; other fields are
+// skipped. Fields missing from the file keep their current values, and so
+// do fields of the wrong type, which are reported in `error` without
+// stopping the fields after them from being read.
+inline bool parseProblemInfoJson(std::string_view json, ProblemInfo& info, std::string& error) {
+    JsonReader reader(json);
+    std::string key;
+    std::vector<std::string> mistyped;
+    auto expect = [&](JsonReader::Type type, const char* what) {
+        if (reader.peekType() == type) return true;
+        if (reader.ok()) mistyped.push_back("\"" + key + "\" is not " + what + ", ignored");
+        reader.skipValue();
+        return false;
+    };
+    auto readText = [&](std::string& field) {
+        if (!expect(JsonReader::Type::String, "a string")) return;
+        field.clear();
+        reader.readString(field);
+    };
+    auto readNumber = [&](double& field) {
+        if (expect(JsonReader::Type::Number, "a number")) reader.readNumber(field);
+    };
+    reader.beginObject();
+    while (reader.nextKey(key)) {
+        if (key == "id") {
+            double id;
+            if (!expect(JsonReader::Type::Number, "an integer") || !reader.readNumber(id)) continue;
+            if (std::abs(id) <= std::numeric_limits<int>::max() && id == std::trunc(id)) {
+                info.id = static_cast<int>(id);
+            } else {
+                mistyped.push_back("\"id\" is not an integer, ignored");
+            }
+        } else if (key == "title") {
+            readText(info.title);
+        } else if (key == "timeLimit") {
+            readText(info.timeLimit);
+        } else if (key == "memoryLimit") {
+            readText(info.memoryLimit);
+        } else if (key == "compare") {
+            readText(info.compareMode);
+        } else if (key == "absoluteError") {
+            readNumber(info.compare.absoluteError);
+        } else if (key == "relativeError") {
+            readNumber(info.compare.relativeError);
+        } else if (key == "outputLimit") {
+            readText(info.outputLimit);
+        } else if (key == "checker") {
+            readText(info.checker);
+        } else if (key == "checkerMode") {
+            readText(info.checkerMode);
+        } else if (key == "interactor") {
+            readText(info.interactor);
+        } else {
+            reader.skipValue();
+        }
+    }
+    reader.end();
+    error = reader.error();
+    for (const std::string& field : mistyped) error += (error.empty() ? "" : "; ") + field;
+    return error.empty();
+}
+
+// Decodes a tests/*.json file straight into `test`. Both "input" and
+// "output" must be present.
+inline bool parseTestCaseJson(std::string_view json, TestCase& test, std::string& error) {
+    JsonReader reader(json);
+    std::string key;
+    bool hasInput = false, hasOutput = false;
+    reader.beginObject();
+    while (reader.nextKey(key)) {
+        if (key == "input") {
+            test.input.clear();
+            hasInput = reader.readString(test.input);
+        } else if (key == "output") {
+            test.expected_output.clear();
+            hasOutput = reader.readString(test.expected_output);
+        } else {
+            reader.skipValue();
+        }
+    }
+    reader.end();
+    error = reader.error();
+    if (reader.ok() && (!hasInput || !hasOutput)) error = hasInput ? "missing \"output\"" : "missing \"input\"";
+    return error.empty();
+}
+
+// `problemsDir` holds one folder per problem; by default the one next to
+// the judge.
+inline ProblemInfo loadProblemInfo(int problemID, const std::filesystem::path& problemsDir = getProblemsPath()) {
+    TraceSpan span("loadProblemInfo", "problem", problemID);
+    ProblemInfo info;
+    info.id = problemID;
+    info.title = "Problem " + std::to_string(problemID);
+    info.timeLimit = "1 second";
+    info.memoryLimit = "256 megabytes";
+    info.outputLimit = "64 megabytes";
+    info.compareMode = "trimmed";
+    info.checkerMode = "testlib";
+    
+    std::filesystem::path infoPath = problemsDir / std::to_string(problemID) / "info.json";
+    
+    std::string json;
+    if (!std::filesystem::exists(infoPath) || !readFile(infoPath, json)) {
+        return info;
+    }
+    
+    std::string error;
+    if (!parseProblemInfoJson(json, info, error)) {
+        std::cerr << "Warning: " << infoPath.string() << ": " << error << "\n";
+    }
+    if (info.title.empty()) info.title = "Problem " + std::to_string(problemID);
+    
+    if (long ms = parseTimeLimitMs(info.timeLimit)) {
+        info.timeLimitMs = ms;
+    } else {
+        std::cerr << "Warning: could not parse time limit '" << info.timeLimit << "', using 1 second\n";
+    }
+    if (long long bytes = parseMemoryLimitBytes(info.memoryLimit)) {
+        info.memoryLimitBytes = bytes;
+    } else {
+        std::cerr << "Warning: could not parse memory limit '" << info.memoryLimit << "', using 256 megabytes\n";
+    }
+    if (long long bytes = parseMemoryLimitBytes(info.outputLimit)) {
+        info.outputLimitBytes = bytes;
+    } else {
+        std::cerr << "Warning: could not parse output limit '" << info.outputLimit << "', using 64 megabytes\n";
+    }
+    if (auto policy = parse_compare_policy(info.compareMode)) {
+        info.compare.policy = *policy;
+    } else {
+        std::cerr << "Warning: unknown compare mode '" << info.compareMode << "', using trimmed\n";
+    }
+    if (info.checkerMode != "testlib" && info.checkerMode != "persistent") {
+        std::cerr << "Warning: unknown checker mode '" << info.checkerMode << "', using testlib\n";
+        info.checkerMode = "testlib";
+    }
+    
+    return info;
+}
+
+// One test in problems/<id>/tests/: either a testN.json file or a pair of
+// raw NN.in/NN.out files.
+struct TestSource {
+    std::filesystem::path json;
+    std::filesystem::path input;
+    std::filesystem::path output;
+
+    bool raw() const { return json.empty(); }
+};
+
+// Lists the tests of a problem, sorted by file name. An .in file without a
+// matching .out file is skipped with a warning.
+inline std::vector<TestSource> listTestSources(int problemID,
+                                               const std::filesystem::path& problemsDir = getProblemsPath()) {
+    TraceSpan span("listTestSources", "problem", problemID);
+    std::vector<TestSource> sources;
+    
+    std::filesystem::path testsDir = problemsDir / std::to_string(problemID) / "tests";
+    
+    if (!std::filesystem::exists(testsDir)) {
+        std::cerr << "Error: Tests directory not found for problem " << problemID << "\n";
+        std::cerr << "Looking in: " << testsDir << "\n";
+        return sources;
+    }
+    
+    // Get all test files and sort them
+    std::vector<std::filesystem::path> testFiles;
+    for (const auto& entry : std::filesystem::directory_iterator(testsDir)) {
+        std::filesystem::path extension = entry.path().extension();
+        if (extension == ".json" || extension == ".in") {
+            testFiles.push_back(entry.path());
+        }
+    }
+    
+    std::sort(testFiles.begin(), testFiles.end());
+    
+    for (const auto& testFile : testFiles) {
+        TestSource source;
+        if (testFile.extension() == ".json") {
+            source.json = testFile;
+        } else {
+            source.input = testFile;
+            source.output = std::filesystem::path(testFile).replace_extension(".out");
+            if (!std::filesystem::exists(source.output)) {
+                std::cerr << "Warning: skipping " << testFile.string() << ": no matching .out file\n";
+                continue;
+            }
+        }
+        sources.push_back(std::move(source));
+    }
+    return sources;
+}
+
+// Loads one test into memory. `buffer` is scratch space for JSON files.
+inline bool loadTestSource(const TestSource& source, TestCase& test, std::string& buffer, std::string& error) {
+    if (source.raw()) {
+        if (readFile(source.input, test.input) && readFile(source.output, test.expected_output)) return true;
+        error = "cannot read test files";
+        return false;
+    }
+    if (!readFile(source.json, buffer)) {
+        error = "cannot read file";
+        return false;
+    }
+    return parseTestCaseJson(buffer, test, error);
+}
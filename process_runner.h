@@ -0,0 +1,441 @@
+#pragma once
+
+// Process runner: starts a program with fork/exec and talks to it through
+// pipes. No shell is involved and nothing is written to disk; the input is
+// fed straight into the child's stdin and stdout/stderr are collected in
+// memory. Input from a file is moved into the pipe by the kernel (splice),
+// so it never passes through the judge's memory.
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "trace.h"
+
+// Zero means "no limit".
+struct ResourceLimits {
+    long cpuTimeMs = 0;              // RLIMIT_CPU, rounded up to whole seconds
+    long wallTimeMs = 0;             // enforced by the runner's watchdog
+    long long memoryBytes = 0;       // RLIMIT_AS and RLIMIT_STACK
+    long long outputBytes = 0;       // stdout size; the child is killed beyond it
+};
+
+class ProcessLauncher;
+
+struct RunOptions {
+    std::vector<std::string> argv;   // argv[0] is the program to execute
+    std::string_view input;          // written to the child's stdin
+    int inputFd = -1;                // or streamed from this file instead
+    std::string workingDir;          // empty = inherit
+    const std::atomic<bool>* cancel = nullptr;  // set to kill the child early
+    ResourceLimits limits;
+    // Sees stdout as it arrives; returning false kills the child.
+    std::function<bool(std::string_view)> onOutput;
+    size_t keepOutputBytes = SIZE_MAX;  // stdout/stderr bytes kept in RunResult
+    const ProcessLauncher* launcher = nullptr;  // starts the child instead of spawn_process()
+};
+
+struct RunResult {
+    bool started = false;            // false if fork/exec failed
+    int exitCode = -1;               // valid when termSignal == 0
+    int termSignal = 0;              // signal that killed the child, if any
+    bool cancelled = false;          // killed because options.cancel was set
+    bool wallTimeExceeded = false;   // killed by the watchdog
+    bool outputLimitExceeded = false;  // killed for writing too much
+    bool outputRejected = false;     // killed because onOutput returned false
+    long long outputBytes = 0;       // total stdout size, kept or not
+    long cpuTimeMs = 0;              // user + system time
+    long wallTimeMs = 0;
+    long peakMemoryKb = 0;           // peak resident set size
+    std::string out;                 // at most keepOutputBytes of stdout
+    std::string err;                 // at most keepOutputBytes of stderr
+    std::string error;               // why the process could not be started
+};
+
+// Looks a bare program name up in PATH. Names containing '/' are returned
+// unchanged. Done before fork() so the child only has to call execv().
+inline std::string resolve_executable(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    const char* pathEnv = std::getenv("PATH");
+    std::string_view paths = pathEnv ? pathEnv : "/usr/local/bin:/usr/bin:/bin";
+    while (!paths.empty()) {
+        size_t sep = paths.find(':');
+        std::string_view dir = paths.substr(0, sep);
+        std::string candidate = std::string(dir.empty() ? "." : dir) + "/" + name;
+        if (access(candidate.c_str(), X_OK) == 0) return candidate;
+        if (sep == std::string_view::npos) break;
+        paths.remove_prefix(sep + 1);
+    }
+    return name;
+}
+
+namespace process_detail {
+
+inline void close_fd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+inline void ignore_sigpipe() {
+    // A child that exits without reading all of its input must not take the
+    // judge down with it; write() reports EPIPE instead.
+    static const bool done = [] {
+        std::signal(SIGPIPE, SIG_IGN);
+        return true;
+    }();
+    (void)done;
+}
+
+inline bool make_pipe(int fds[2]) {
+    return pipe2(fds, O_CLOEXEC) == 0;
+}
+
+// Called in the child between fork() and exec(); async-signal-safe only.
+inline bool apply_limits(const ResourceLimits& limits) {
+    if (limits.cpuTimeMs > 0) {
+        rlim_t seconds = static_cast<rlim_t>((limits.cpuTimeMs + 999) / 1000);
+        // SIGXCPU once the limit is used up, SIGKILL one second later.
+        rlimit cpu{seconds, seconds + 1};
+        if (setrlimit(RLIMIT_CPU, &cpu) != 0) return false;
+    }
+    if (limits.memoryBytes > 0) {
+        rlimit mem{static_cast<rlim_t>(limits.memoryBytes), static_cast<rlim_t>(limits.memoryBytes)};
+        if (setrlimit(RLIMIT_AS, &mem) != 0) return false;
+        if (setrlimit(RLIMIT_STACK, &mem) != 0) return false;
+    }
+    rlimit core{0, 0};
+    setrlimit(RLIMIT_CORE, &core);
+    return true;
+}
+
+// Moves the next chunk of `fd` (from `offset`) into the pipe `pipeFd`.
+// Returns the number of bytes moved, 0 at end of file, -1 with errno set.
+inline ssize_t stream_file_chunk(int fd, off_t& offset, int pipeFd) {
+    constexpr size_t chunk = 1 << 16;
+    ssize_t n = splice(fd, &offset, pipeFd, nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n >= 0 || (errno != EINVAL && errno != ENOSYS)) return n;
+    // Not spliceable (e.g. a file system without splice_read).
+    n = sendfile(pipeFd, fd, &offset, chunk);
+    if (n >= 0 || (errno != EINVAL && errno != ENOSYS)) return n;
+    char buf[chunk];
+    n = pread(fd, buf, sizeof(buf), offset);
+    if (n <= 0) return n;
+    ssize_t w = write(pipeFd, buf, static_cast<size_t>(n));
+    if (w > 0) offset += w;
+    return w;
+}
+
+inline int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+} // namespace process_detail
+
+struct SpawnOptions {
+    std::vector<std::string> argv;   // argv[0] is the program to execute
+    std::vector<std::string> env;    // NAME=value added to the inherited environment
+    std::string workingDir;          // empty = inherit
+    ResourceLimits limits;           // only the rlimits apply here
+    int stdinFd = -1;                // -1 = /dev/null
+    int stdoutFd = -1;
+    int stderrFd = -1;
+    const std::atomic<bool>* cancel = nullptr;  // launchers stop waiting to start the child once set
+};
+
+// A child started by spawn_process(). It leads its own process group, so
+// kill(-pid, ...) also reaches anything it forks.
+struct SpawnedProcess {
+    pid_t pid = -1;                  // -1 if it could not be started
+    std::string error;
+};
+
+// Starts a program with the given descriptors as stdin/stdout/stderr and
+// returns once it has been exec'd (or failed to).
+inline SpawnedProcess spawn_process(const SpawnOptions& options) {
+    using process_detail::close_fd;
+
+    SpawnedProcess spawned;
+    if (options.argv.empty()) {
+        spawned.error = "empty command line";
+        return spawned;
+    }
+
+    process_detail::ignore_sigpipe();
+
+    // Everything the child needs is prepared before fork().
+    std::string program = resolve_executable(options.argv[0]);
+    std::vector<char*> argv;
+    argv.reserve(options.argv.size() + 1);
+    for (const auto& arg : options.argv) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    std::vector<char*> envp;
+    if (!options.env.empty()) {
+        for (char** e = environ; *e; ++e) envp.push_back(*e);
+        for (const auto& var : options.env) envp.push_back(const_cast<char*>(var.c_str()));
+        envp.push_back(nullptr);
+    }
+    const char* workingDir = options.workingDir.empty() ? nullptr : options.workingDir.c_str();
+    const ResourceLimits limits = options.limits;
+    const int stdio[3] = {options.stdinFd, options.stdoutFd, options.stderrFd};
+
+    int execPipe[2] = {-1, -1};
+    if (!process_detail::make_pipe(execPipe)) {
+        spawned.error = std::string("pipe: ") + std::strerror(errno);
+        return spawned;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        spawned.error = std::string("fork: ") + std::strerror(errno);
+        close_fd(execPipe[0]);
+        close_fd(execPipe[1]);
+        return spawned;
+    }
+
+    if (pid == 0) {
+        // Child: only async-signal-safe calls from here on. It gets its own
+        // process group so that anything it forks is killed along with it.
+        setpgid(0, 0);
+        std::signal(SIGPIPE, SIG_DFL);
+        bool ok = true;
+        for (int target = 0; target < 3 && ok; ++target) {
+            int fd = stdio[target] >= 0 ? stdio[target] : open("/dev/null", target == 0 ? O_RDONLY : O_WRONLY);
+            ok = fd >= 0 && dup2(fd, target) >= 0;
+        }
+        if (!ok || (workingDir && chdir(workingDir) != 0) || !process_detail::apply_limits(limits)) {
+            int err = errno;
+            (void)!write(execPipe[1], &err, sizeof(err));
+            _exit(127);
+        }
+        if (envp.empty()) {
+            execv(program.c_str(), argv.data());
+        } else {
+            execve(program.c_str(), argv.data(), envp.data());
+        }
+        int err = errno;
+        (void)!write(execPipe[1], &err, sizeof(err));
+        _exit(127);
+    }
+    setpgid(pid, pid);  // also from the parent, to close the race with kill()
+    close_fd(execPipe[1]);
+
+    // The exec pipe is closed by a successful execv() (O_CLOEXEC) and carries
+    // errno if anything failed before that.
+    int execErrno = 0;
+    ssize_t n;
+    do {
+        n = read(execPipe[0], &execErrno, sizeof(execErrno));
+    } while (n < 0 && errno == EINTR);
+    close_fd(execPipe[0]);
+
+    if (n > 0) {
+        waitpid(pid, nullptr, 0);
+        spawned.error = "cannot execute " + program + ": " + std::strerror(execErrno);
+        return spawned;
+    }
+    spawned.pid = pid;
+    return spawned;
+}
+
+// Starts and reaps children on behalf of run_process(), in place of
+// spawn_process() and wait4(); see fork_server.h. The child must lead its
+// own process group, as with spawn_process().
+class ProcessLauncher {
+public:
+    virtual ~ProcessLauncher() = default;
+    virtual SpawnedProcess spawn(const SpawnOptions& options) const = 0;
+    // A descriptor that becomes readable once `pid` has exited; the caller
+    // closes it. -1 if there is none (the caller then polls wait()).
+    virtual int exitFd(pid_t pid) const = 0;
+    // Like wait4(pid, status, flags, usage) with flags 0 or WNOHANG.
+    virtual pid_t wait(pid_t pid, int* status, int flags, rusage* usage) const = 0;
+};
+
+inline RunResult run_process(const RunOptions& options) {
+    using process_detail::close_fd;
+    using Clock = std::chrono::steady_clock;
+
+    RunResult result;
+    const ResourceLimits limits = options.limits;
+
+    int inPipe[2] = {-1, -1}, outPipe[2] = {-1, -1}, errPipe[2] = {-1, -1};
+    if (!process_detail::make_pipe(inPipe) || !process_detail::make_pipe(outPipe) ||
+        !process_detail::make_pipe(errPipe)) {
+        result.error = std::string("pipe: ") + std::strerror(errno);
+        for (int* p : {inPipe, outPipe, errPipe}) {
+            close_fd(p[0]);
+            close_fd(p[1]);
+        }
+        return result;
+    }
+
+    const Clock::time_point startTime = Clock::now();
+    SpawnOptions spawn;
+    spawn.argv = options.argv;
+    spawn.workingDir = options.workingDir;
+    spawn.limits = limits;
+    spawn.stdinFd = inPipe[0];
+    spawn.stdoutFd = outPipe[1];
+    spawn.stderrFd = errPipe[1];
+    spawn.cancel = options.cancel;
+    TraceSpan spawnSpan("spawn");
+    SpawnedProcess child = options.launcher ? options.launcher->spawn(spawn) : spawn_process(spawn);
+    spawnSpan.end();
+    close_fd(inPipe[0]);
+    close_fd(outPipe[1]);
+    close_fd(errPipe[1]);
+
+    if (child.pid < 0) {
+        close_fd(inPipe[1]);
+        close_fd(outPipe[0]);
+        close_fd(errPipe[0]);
+        result.error = child.error;
+        return result;
+    }
+    const pid_t pid = child.pid;
+    result.started = true;
+    // Until the child is reaped: feeding input, capturing output and the
+    // streaming comparison in onOutput.
+    TraceSpan runSpan("run");
+
+    fcntl(inPipe[1], F_SETFL, O_NONBLOCK);
+    size_t written = 0;
+    off_t inputOffset = 0;
+    const bool inputFromFile = options.inputFd >= 0;
+    if (!inputFromFile && options.input.empty()) close_fd(inPipe[1]);
+
+    // A pidfd makes the child's exit show up in poll(); without one (old
+    // kernels) the loop wakes up periodically and checks with WNOHANG.
+    int pidFd = options.launcher ? options.launcher->exitFd(pid) : process_detail::open_pidfd(pid);
+    const bool hasDeadline = limits.wallTimeMs > 0;
+    const Clock::time_point deadline = startTime + std::chrono::milliseconds(limits.wallTimeMs);
+
+    bool exited = false;
+    int status = 0;
+    rusage usage{};
+    auto reap = [&](int flags) {
+        pid_t r;
+        do {
+            r = options.launcher ? options.launcher->wait(pid, &status, flags, &usage)
+                                 : wait4(pid, &status, flags, &usage);
+        } while (r < 0 && errno == EINTR);
+        if (r == pid) {
+            exited = true;
+            result.wallTimeMs = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime).count());
+            // Leftover processes in the group could keep the pipes open.
+            kill(-pid, SIGKILL);
+            close_fd(pidFd);
+        }
+    };
+    auto killChild = [&] {
+        kill(-pid, SIGKILL);
+        close_fd(inPipe[1]);
+    };
+
+    char buf[65536];
+    while (!exited || inPipe[1] >= 0 || outPipe[0] >= 0 || errPipe[0] >= 0) {
+        if (!exited && options.cancel && !result.cancelled && options.cancel->load()) {
+            result.cancelled = true;
+            killChild();
+        }
+        if (!exited && hasDeadline && !result.wallTimeExceeded && Clock::now() >= deadline) {
+            result.wallTimeExceeded = true;
+            killChild();
+        }
+
+        pollfd fds[4];
+        int count = 0;
+        int inIdx = -1, outIdx = -1, errIdx = -1, pidIdx = -1;
+        if (inPipe[1] >= 0) { inIdx = count; fds[count++] = {inPipe[1], POLLOUT, 0}; }
+        if (outPipe[0] >= 0) { outIdx = count; fds[count++] = {outPipe[0], POLLIN, 0}; }
+        if (errPipe[0] >= 0) { errIdx = count; fds[count++] = {errPipe[0], POLLIN, 0}; }
+        if (pidFd >= 0) { pidIdx = count; fds[count++] = {pidFd, POLLIN, 0}; }
+
+        int timeout = -1;
+        if (!exited) {
+            if (options.cancel || pidFd < 0) timeout = 10;
+            if (hasDeadline && !result.wallTimeExceeded) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                left = left < 0 ? 0 : left + 1;
+                if (timeout < 0 || left < timeout) timeout = static_cast<int>(left);
+            }
+        }
+
+        int ready = poll(fds, count, timeout);
+        if (ready < 0 && errno != EINTR) break;
+        if (!exited && (pidFd < 0 || (pidIdx >= 0 && fds[pidIdx].revents))) reap(WNOHANG);
+        if (ready <= 0) continue;
+
+        if (inIdx >= 0 && fds[inIdx].revents && inPipe[1] >= 0 && inputFromFile) {
+            ssize_t w = process_detail::stream_file_chunk(options.inputFd, inputOffset, inPipe[1]);
+            if (w == 0 || (w < 0 && errno != EAGAIN && errno != EINTR)) close_fd(inPipe[1]);
+        } else if (inIdx >= 0 && fds[inIdx].revents && inPipe[1] >= 0) {
+            ssize_t w = write(inPipe[1], options.input.data() + written, options.input.size() - written);
+            if (w > 0) written += static_cast<size_t>(w);
+            if ((w < 0 && errno != EAGAIN && errno != EINTR) || written == options.input.size()) {
+                close_fd(inPipe[1]);
+            }
+        }
+        for (auto [idx, fd, sink] : {std::tuple{outIdx, &outPipe[0], &result.out},
+                                     std::tuple{errIdx, &errPipe[0], &result.err}}) {
+            if (idx < 0 || !fds[idx].revents) continue;
+            ssize_t r = read(*fd, buf, sizeof(buf));
+            if (r > 0) {
+                std::string_view chunk(buf, static_cast<size_t>(r));
+                if (sink->size() < options.keepOutputBytes) {
+                    sink->append(chunk.substr(0, options.keepOutputBytes - sink->size()));
+                }
+                if (sink != &result.out || result.outputLimitExceeded || result.outputRejected) continue;
+                result.outputBytes += r;
+                if (limits.outputBytes > 0 && result.outputBytes > limits.outputBytes) {
+                    result.outputLimitExceeded = true;
+                    if (!exited) killChild();
+                } else if (options.onOutput && !options.onOutput(chunk)) {
+                    result.outputRejected = true;
+                    if (!exited) killChild();
+                }
+            } else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+                close_fd(*fd);
+            }
+        }
+    }
+    close_fd(inPipe[1]);
+    close_fd(outPipe[0]);
+    close_fd(errPipe[0]);
+    if (!exited) reap(0);
+    close_fd(pidFd);
+
+    if (WIFEXITED(status)) {
+        result.exitCode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        result.termSignal = WTERMSIG(status);
+    }
+    result.cpuTimeMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000L +
+                       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000L;
+    result.peakMemoryKb = usage.ru_maxrss;
+    return result;
+}
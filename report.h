@@ -0,0 +1,149 @@
+#pragma once
+
+// Judging results of whole submissions and how they are written out: JSON
+// (batch reports, judge server responses) and CSV.
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "test_executor.h"
+
+struct BatchItem {
+    int problemID = 0;
+    std::string path;
+};
+
+struct TestRecord {
+    size_t test = 0;                   // 1-based
+    Verdict verdict = Verdict::JudgeError;
+    long cpuTimeMs = 0;
+    long wallTimeMs = 0;
+    long peakMemoryKb = 0;
+    std::string output;                // start of the output of a failed test
+    std::string message;               // where the output differs, if known
+};
+
+struct SubmissionRecord {
+    BatchItem item;
+    Verdict verdict = Verdict::JudgeError;
+    std::string message;               // compiler output or judge error
+    size_t passed = 0;
+    size_t total = 0;
+    size_t failedTest = 0;             // 1-based, 0 if none failed
+    bool fromCache = false;
+    long compileMs = 0;
+    long judgeMs = 0;                  // compile + tests
+    std::vector<TestRecord> tests;
+};
+
+// Length of the well-formed UTF-8 sequence starting at `text[i]`, or 0 if
+// the bytes there are not one (stray continuation bytes, overlong forms,
+// surrogates, truncated sequences).
+inline size_t utf8_sequence_length(std::string_view text, size_t i) {
+    auto byte = [&](size_t k) { return i + k < text.size() ? static_cast<unsigned char>(text[i + k]) : 0u; };
+    auto continuation = [&](size_t k) { return (byte(k) & 0xC0) == 0x80; };
+    const unsigned lead = byte(0);
+    if (lead < 0x80) return 1;
+    if (lead >= 0xC2 && lead <= 0xDF) return continuation(1) ? 2 : 0;
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        const unsigned low = lead == 0xE0 ? 0xA0 : 0x80, high = lead == 0xED ? 0x9F : 0xBF;
+        return byte(1) >= low && byte(1) <= high && continuation(2) ? 3 : 0;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        const unsigned low = lead == 0xF0 ? 0x90 : 0x80, high = lead == 0xF4 ? 0x8F : 0xBF;
+        return byte(1) >= low && byte(1) <= high && continuation(2) && continuation(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+// Submission output and compiler messages may hold any bytes; those that
+// are not valid UTF-8 become U+FFFD so the report stays valid JSON.
+inline std::string json_escape(std::string_view text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (size_t i = 0; i < text.size();) {
+        const char c = text[i];
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else if (size_t length = utf8_sequence_length(text, i)) {
+                    out.append(text, i, length);
+                    i += length;
+                    continue;
+                } else {
+                    out += "\\ufffd";
+                }
+        }
+        ++i;
+    }
+    return out;
+}
+
+inline std::string csv_escape(const std::string& text) {
+    if (text.find_first_of(",\"\n\r") == std::string::npos) return text;
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// One submission as a single-line JSON object.
+inline void write_submission_json(std::ostream& out, const SubmissionRecord& r) {
+    out << "{\"path\": \"" << json_escape(r.item.path) << "\", \"problem\": " << r.item.problemID
+        << ", \"verdict\": \"" << verdict_code(r.verdict) << "\", \"passed\": " << r.passed
+        << ", \"total\": " << r.total << ", \"failedTest\": " << r.failedTest
+        << ", \"cached\": " << (r.fromCache ? "true" : "false") << ", \"compileMs\": " << r.compileMs
+        << ", \"judgeMs\": " << r.judgeMs;
+    if (!r.message.empty()) out << ", \"message\": \"" << json_escape(r.message) << "\"";
+    out << ", \"tests\": [";
+    for (size_t t = 0; t < r.tests.size(); ++t) {
+        const TestRecord& test = r.tests[t];
+        out << (t ? ", " : "") << "{\"test\": " << test.test << ", \"verdict\": \"" << verdict_code(test.verdict)
+            << "\", \"cpuMs\": " << test.cpuTimeMs << ", \"wallMs\": " << test.wallTimeMs
+            << ", \"memoryKb\": " << test.peakMemoryKb;
+        if (!test.output.empty()) out << ", \"output\": \"" << json_escape(test.output) << "\"";
+        if (!test.message.empty()) out << ", \"message\": \"" << json_escape(test.message) << "\"";
+        out << "}";
+    }
+    out << "]}";
+}
+
+inline void write_batch_json(std::ostream& out, const std::vector<SubmissionRecord>& records, double seconds) {
+    size_t accepted = std::count_if(records.begin(), records.end(),
+                                    [](const SubmissionRecord& r) { return r.verdict == Verdict::Accepted; });
+    out << "{\n  \"summary\": {\"submissions\": " << records.size() << ", \"accepted\": " << accepted
+        << ", \"seconds\": " << seconds << ", \"submissionsPerMinute\": "
+        << (seconds > 0 ? records.size() * 60.0 / seconds : 0.0) << "},\n  \"submissions\": [";
+    for (size_t i = 0; i < records.size(); ++i) {
+        out << (i ? ",\n    " : "\n    ");
+        write_submission_json(out, records[i]);
+    }
+    out << "\n  ]\n}\n";
+}
+
+// One row per submission (test column empty) followed by one row per test.
+inline void write_batch_csv(std::ostream& out, const std::vector<SubmissionRecord>& records) {
+    out << "path,problem,test,verdict,passed,total,compile_ms,cpu_ms,wall_ms,memory_kb\n";
+    for (const SubmissionRecord& r : records) {
+        std::string path = csv_escape(r.item.path);
+        out << path << "," << r.item.problemID << ",," << verdict_code(r.verdict) << "," << r.passed << ","
+            << r.total << "," << r.compileMs << ",,,\n";
+        for (const TestRecord& test : r.tests) {
+            out << path << "," << r.item.problemID << "," << test.test << "," << verdict_code(test.verdict)
+                << ",,,," << test.cpuTimeMs << "," << test.wallTimeMs << "," << test.peakMemoryKb << "\n";
+        }
+    }
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+// Scheduler for judging many submissions at once. Each submission is one
+// compile task followed by one run task per test, and all of them share a
+// single pool of worker threads, so a submission stuck on a long test does
+// not hold up a core while others wait.
+//
+// Submissions with work left form a ring. A worker that runs out of tasks
+// takes the next one in turn: its compile, or a small chunk of its tests,
+// which go into the worker's own deque. Workers take tasks from the front
+// of their own deque and, once it is empty, steal the back half of another
+// worker's, so the tests claimed by a worker stuck on a long one are picked
+// up by the others. Since chunks are small and handed out in turn, a
+// submission with hundreds of tests cannot starve one with a single test.
+//
+// At most `compiles` compiles and `runs` test runs happen at the same time,
+// and no more than `open` submissions are past their compile and not done.
+// Per submission, tests are reported as by run_test_cases(): in index
+// order, up to and including the lowest failing test.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "test_executor.h"
+
+struct SchedulerLimits {
+    unsigned compiles = 1;                       // concurrent compiles
+    unsigned runs = default_worker_count();      // concurrent test runs
+    // Submissions compiled (or compiling) but not done, which bounds the
+    // binaries and loaded tests held at once. 0 = 2 * runs + compiles.
+    unsigned open = 0;
+};
+
+// What the scheduler needs to know about one submission.
+struct SubmissionTasks {
+    // Compiles the submission. Returns how many tests to run, 0 if there is
+    // nothing to run (e.g. it did not compile), and fills in their order
+    // (a permutation of the indices, empty = index order).
+    std::function<size_t(std::vector<size_t>& order)> compile;
+    TestFunction runTest;
+    TestReporter report;
+    // Called after the last report with the index of the lowest failing
+    // test, or the test count if all passed. Not called without tests.
+    std::function<void(size_t failed)> done;
+    bool stopOnFailure = true;
+};
+
+class TaskScheduler {
+public:
+    explicit TaskScheduler(SchedulerLimits limits)
+        : limits_{std::max(1u, limits.compiles), std::max(1u, limits.runs),
+                  limits.open ? limits.open : 2 * std::max(1u, limits.runs) + std::max(1u, limits.compiles)},
+          workers_(limits_.compiles + limits_.runs) {
+        for (Worker& worker : workers_) worker.thread = std::thread([this, &worker] { loop(worker); });
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Finishes every submission first.
+    ~TaskScheduler() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        workAvailable_.notify_all();
+        for (Worker& worker : workers_) worker.thread.join();
+    }
+
+    void submit(SubmissionTasks tasks) {
+        auto submission = std::make_shared<Submission>();
+        submission->tasks = std::move(tasks);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ring_.push_back(std::move(submission));
+            ++active_;
+        }
+        workAvailable_.notify_all();
+    }
+
+    // Blocks until every submitted submission is done.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [&] { return active_ == 0; });
+    }
+
+private:
+    static constexpr size_t compileTask = SIZE_MAX;
+    static constexpr size_t claimQuantum = 4;    // tests a worker claims at a time
+
+    struct Submission {
+        SubmissionTasks tasks;
+        enum Phase { Waiting, Compiling, Running } phase = Waiting;
+        size_t count = 0;
+        std::vector<size_t> order;
+        size_t nextPosition = 0;                 // in order; guarded by mutex_
+        std::atomic<size_t> firstFailure{0};
+        std::atomic<size_t> finished{0};         // tests run or skipped
+        std::mutex reportMutex;
+        std::vector<std::optional<TestOutcome>> pending;
+        size_t nextToReport = 0;
+    };
+
+    struct Task {
+        std::shared_ptr<Submission> submission;
+        size_t index = compileTask;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;                  // claimed run tasks, next first
+        // The test being run, so a failure can cancel it.
+        std::atomic<Submission*> submission{nullptr};
+        std::atomic<size_t> index{SIZE_MAX};
+        std::atomic<bool> cancel{false};
+        std::thread thread;
+    };
+
+    static bool reserve(std::atomic<unsigned>& active, unsigned limit) {
+        unsigned current = active.load();
+        while (current < limit && !active.compare_exchange_weak(current, current + 1)) {}
+        return current < limit;
+    }
+
+    // Wakes idle workers after a change they cannot wait on under mutex_.
+    void wake() {
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        workAvailable_.notify_all();
+    }
+
+    void loop(Worker& self) {
+        while (true) {
+            Task task;
+            if (!next(self, task)) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                workAvailable_.wait(lock, [&] {
+                    return stopping_ || (queued_.load() > 0 && runsActive_.load() < limits_.runs) || claimable();
+                });
+                if (stopping_) return;
+                continue;
+            }
+            if (task.index == compileTask) {
+                compile(task.submission);
+            } else {
+                run(self, task);
+            }
+        }
+    }
+
+    // Picks the next task and reserves its compile or run slot.
+    bool next(Worker& self, Task& task) {
+        if (reserve(runsActive_, limits_.runs)) {
+            if (popLocal(self, task) || steal(self, task)) return true;
+            --runsActive_;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return claim(self, task);
+    }
+
+    bool popLocal(Worker& self, Task& task) {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (self.tasks.empty()) return false;
+        task = std::move(self.tasks.front());
+        self.tasks.pop_front();
+        --queued_;
+        return true;
+    }
+
+    // Moves the back half of the fullest other deque to ours.
+    bool steal(Worker& self, Task& task) {
+        if (queued_.load() == 0) return false;
+        Worker* victim = nullptr;
+        size_t most = 0;
+        for (Worker& other : workers_) {
+            if (&other == &self) continue;
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (other.tasks.size() > most) {
+                most = other.tasks.size();
+                victim = &other;
+            }
+        }
+        if (!victim) return false;
+        std::scoped_lock lock(victim->mutex, self.mutex);
+        if (victim->tasks.empty()) return false;
+        size_t take = (victim->tasks.size() + 1) / 2;
+        auto from = victim->tasks.end() - static_cast<std::ptrdiff_t>(take);
+        task = std::move(*from);
+        self.tasks.insert(self.tasks.end(), std::make_move_iterator(from + 1),
+                          std::make_move_iterator(victim->tasks.end()));
+        victim->tasks.erase(from, victim->tasks.end());
+        --queued_;
+        return true;
+    }
+
+    // Whether claim() would find something; mutex_ held.
+    bool claimable() const {
+        const bool compileFree = compilesActive_.load() < limits_.compiles && open_ < limits_.open;
+        const bool runFree = runsActive_.load() < limits_.runs;
+        for (const auto& s : ring_) {
+            if (s->phase == Submission::Waiting && compileFree) return true;
+            if (s->phase == Submission::Running && s->nextPosition < s->count && runFree) return true;
+        }
+        return false;
+    }
+
+    // Takes the compile or a chunk of tests of the next submission in the
+    // ring that has either; mutex_ held.
+    bool claim(Worker& self, Task& task) {
+        for (size_t n = 0; n < ring_.size(); ++n) {
+            const size_t at = (cursor_ + n) % ring_.size();
+            const std::shared_ptr<Submission>& s = ring_[at];
+            if (s->phase == Submission::Waiting && open_ < limits_.open && reserve(compilesActive_, limits_.compiles)) {
+                s->phase = Submission::Compiling;
+                ++open_;
+                task = {s, compileTask};
+            } else if (s->phase == Submission::Running && s->nextPosition < s->count &&
+                       reserve(runsActive_, limits_.runs)) {
+                const size_t left = s->count - s->nextPosition;
+                const size_t take = std::min({claimQuantum, left, (left + limits_.runs - 1) / limits_.runs});
+                auto indexAt = [&](size_t position) { return s->order.empty() ? position : s->order[position]; };
+                task = {s, indexAt(s->nextPosition++)};
+                std::lock_guard<std::mutex> lock(self.mutex);
+                for (size_t i = 1; i < take; ++i) self.tasks.push_back({s, indexAt(s->nextPosition++)});
+                queued_ += take - 1;
+            } else {
+                continue;
+            }
+            cursor_ = at + 1;
+            return true;
+        }
+        return false;
+    }
+
+    void compile(const std::shared_ptr<Submission>& s) {
+        std::vector<size_t> order;
+        const size_t count = s->tasks.compile(order);
+        --compilesActive_;
+        if (count == 0) {
+            finish(s);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            s->count = count;
+            s->order = std::move(order);
+            s->pending.resize(count);
+            s->firstFailure = count;
+            s->phase = Submission::Running;
+        }
+        workAvailable_.notify_all();
+    }
+
+    void run(Worker& self, const Task& task) {
+        Submission& s = *task.submission;
+        const size_t index = task.index;
+        const bool stopOnFailure = s.tasks.stopOnFailure;
+        // Publish the test before checking for failures so that a
+        // concurrent recordFailure() either sees it or is seen here.
+        self.cancel = false;
+        self.index = SIZE_MAX;
+        self.submission = &s;
+        self.index = index;
+        std::optional<TestOutcome> outcome;
+        if (!stopOnFailure || index <= s.firstFailure.load()) {
+            outcome = s.tasks.runTest(index, self.cancel);
+            // A cancel meant for this worker's previous test can arrive
+            // late; a test below the first failure is still needed.
+            while (outcome->run.cancelled && index < s.firstFailure.load()) {
+                self.cancel = false;
+                outcome = s.tasks.runTest(index, self.cancel);
+            }
+        }
+        self.submission = nullptr;
+        --runsActive_;
+        wake();
+
+        if (outcome && !outcome->run.cancelled) {
+            if (!outcome->passed()) recordFailure(s, index);
+            std::lock_guard<std::mutex> lock(s.reportMutex);
+            s.pending[index] = std::move(outcome);
+            while (s.nextToReport < s.count && (!stopOnFailure || s.nextToReport <= s.firstFailure.load()) &&
+                   s.pending[s.nextToReport]) {
+                s.tasks.report(s.nextToReport, *s.pending[s.nextToReport]);
+                s.pending[s.nextToReport].reset();
+                ++s.nextToReport;
+            }
+        }
+        if (++s.finished == s.count) {
+            s.tasks.done(s.firstFailure.load());
+            finish(task.submission);
+        }
+    }
+
+    // Cancels the tests of `s` after `index` that are running now; those
+    // not started yet are skipped when their turn comes.
+    void recordFailure(Submission& s, size_t index) {
+        size_t seen = s.firstFailure.load();
+        while (index < seen && !s.firstFailure.compare_exchange_weak(seen, index)) {}
+        if (index >= seen || !s.tasks.stopOnFailure) return;
+        for (Worker& worker : workers_) {
+            if (worker.submission.load() != &s) continue;
+            size_t running = worker.index.load();
+            if (running != SIZE_MAX && running > index) worker.cancel = true;
+        }
+    }
+
+    void finish(const std::shared_ptr<Submission>& s) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find(ring_.begin(), ring_.end(), s);
+            const size_t at = static_cast<size_t>(it - ring_.begin());
+            if ((*it)->phase != Submission::Waiting) --open_;
+            ring_.erase(it);
+            if (at < cursor_) --cursor_;
+            if (cursor_ >= ring_.size()) cursor_ = 0;
+            --active_;
+        }
+        workAvailable_.notify_all();
+        idle_.notify_all();
+    }
+
+    const SchedulerLimits limits_;
+    std::vector<Worker> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable idle_;
+    std::vector<std::shared_ptr<Submission>> ring_;   // submissions not done yet
+    size_t cursor_ = 0;                               // next in turn
+    size_t active_ = 0;
+    unsigned open_ = 0;                               // compiling or compiled, not done
+    bool stopping_ = false;
+
+    std::atomic<size_t> queued_{0};                   // tasks in all deques
+    std::atomic<unsigned> compilesActive_{0};
+    std::atomic<unsigned> runsActive_{0};
+};
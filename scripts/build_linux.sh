@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Build the dynamic judge natively for Linux judging hosts
+# Requirements: g++ with C++17 support
+
+ROOT_DIR="$(cd "$(dirname "$0")"/.. && pwd)"
+OUT_DIR="$ROOT_DIR/dist/linux64"
+JUDGE_BIN="$OUT_DIR/judge"
+MAIN_CPP="$ROOT_DIR/main_dynamic.cpp"
+
+: "${CXX:=g++}"
+
+mkdir -p "$OUT_DIR"
+
+# 1) Compile judge
+echo "[1/2] Compiling judge for Linux..."
+"$CXX" -O2 -std=c++17 -pthread -o "$JUDGE_BIN" "$MAIN_CPP"
+
+echo "✓ Compilation OK: $JUDGE_BIN"
+
+# Custom checkers are compiled with the judge folder on the include path
+cp "$ROOT_DIR/judge_checker.h" "$OUT_DIR/judge_checker.h"
+
+# 2) Copy problems next to the judge
+echo "[2/2] Copying problems..."
+rm -rf "$OUT_DIR/problems"
+cp -R "$ROOT_DIR/dist/win64/problems" "$OUT_DIR/problems"
+
+echo "✓ Problems copied to $OUT_DIR/problems"
+echo ""
+echo "Run with: $JUDGE_BIN"
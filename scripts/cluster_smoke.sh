@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Smoke test of distributed judging on one machine: starts a judge server as
+# cluster coordinator and two workers on localhost, then judges a correct and
+# a wrong submission through them and checks the verdicts.
+# Requirements: g++ with C++17 support
+#
+#   bash scripts/cluster_smoke.sh [PROBLEM_ID] [CORRECT_SOURCE]
+
+ROOT_DIR="$(cd "$(dirname "$0")"/.. && pwd)"
+JUDGE_BIN="$ROOT_DIR/dist/linux64/judge"
+PROBLEM="${1:-2}"
+CORRECT="${2:-$ROOT_DIR/samples/problem${PROBLEM}_correct.cpp}"
+PORT="${CLUSTER_SMOKE_PORT:-$((20000 + RANDOM % 20000))}"
+
+bash "$ROOT_DIR/scripts/build_linux.sh" >/dev/null
+
+WORK_DIR="$(mktemp -d)"
+PIDS=()
+cleanup() {
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null || true; done
+    wait 2>/dev/null || true
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+export JUDGE_CLUSTER_TOKEN="smoke-$RANDOM$RANDOM"
+SOCKET="$WORK_DIR/judge.sock"
+
+"$JUDGE_BIN" --serve --socket "$SOCKET" --cluster-listen "$PORT" --no-cache 2>"$WORK_DIR/server.log" &
+PIDS+=($!)
+for worker in 1 2; do
+    "$JUDGE_BIN" --worker "127.0.0.1:$PORT" --jobs 2 --work-dir "$WORK_DIR/worker$worker" \
+        2>"$WORK_DIR/worker$worker.log" &
+    PIDS+=($!)
+done
+
+# Wait until both workers have joined
+for _ in $(seq 100); do
+    [ "$(grep -c "joined with" "$WORK_DIR/server.log" || true)" -ge 2 ] && break
+    sleep 0.1
+done
+if [ "$(grep -c "joined with" "$WORK_DIR/server.log" || true)" -lt 2 ]; then
+    echo "✗ Workers did not join:" >&2
+    cat "$WORK_DIR"/*.log >&2
+    exit 1
+fi
+
+cat >"$WORK_DIR/wrong.cpp" <<'EOF'
+int main() { return 0; }
+EOF
+
+expect() {
+    local label="$1" expected="$2"
+    shift 2
+    local response verdict
+    response="$("$JUDGE_BIN" --socket "$SOCKET" "$@")"
+    # The first verdict is the submission's, the rest are per test
+    verdict="$(grep -o '"verdict": "[A-Z]*"' <<<"$response" | head -n 1 | cut -d'"' -f4)"
+    if [ "$verdict" != "$expected" ]; then
+        echo "✗ $label: expected $expected, got: $response" >&2
+        cat "$WORK_DIR"/*.log >&2
+        exit 1
+    fi
+    echo "✓ $label"
+}
+
+expect "correct submission" AC --submit "$PROBLEM" "$CORRECT"
+expect "correct submission, all tests" AC --all-tests --submit "$PROBLEM" "$CORRECT"
+expect "wrong submission" WA --submit "$PROBLEM" "$WORK_DIR/wrong.cpp"
+
+if grep -q " left$" "$WORK_DIR/server.log"; then
+    echo "✗ A worker disconnected during the run:" >&2
+    cat "$WORK_DIR"/*.log >&2
+    exit 1
+fi
+# Workers keep the binaries they ran, so both should have fetched some
+for worker in 1 2; do
+    if [ -z "$(ls -A "$WORK_DIR/worker$worker/binaries" 2>/dev/null)" ]; then
+        echo "✗ Worker $worker ran no tests" >&2
+        exit 1
+    fi
+done
+echo "✓ Judged on 2 local workers"
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Build and run the judge microbenchmarks
+# Requirements: g++ with C++17 support
+#
+# Arguments are passed to the benchmark, e.g.:
+#   bash scripts/run_benchmarks.sh --out bench.json
+#   bash scripts/run_benchmarks.sh --baseline bench.json --tolerance 15
+
+ROOT_DIR="$(cd "$(dirname "$0")"/.. && pwd)"
+OUT_DIR="$ROOT_DIR/dist/linux64"
+BENCH_BIN="$OUT_DIR/judge_bench"
+BENCH_CPP="$ROOT_DIR/judge_bench.cpp"
+
+: "${CXX:=g++}"
+
+mkdir -p "$OUT_DIR"
+
+# Same flags as the judge itself, so the numbers describe the shipped build
+echo "Compiling benchmarks..." >&2
+"$CXX" -O2 -std=c++17 -pthread -o "$BENCH_BIN" "$BENCH_CPP"
+
+"$BENCH_BIN" "$@"
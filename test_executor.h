@@ -0,0 +1,184 @@
+#pragma once
+
+// Runs the test cases of one submission, optionally on several worker
+// threads and in any execution order. Whatever the worker count and order,
+// the result is the same as running the tests one after another and
+// stopping at the first failure: the lowest failing test is the one
+// reported, tests after it are cancelled, and tests before it still run.
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "process_runner.h"
+
+enum class Verdict {
+    Accepted,
+    WrongAnswer,
+    TimeLimitExceeded,
+    MemoryLimitExceeded,
+    OutputLimitExceeded,
+    RuntimeError,
+    JudgeError,           // the submission could not be started at all
+    CompilationError,     // whole-submission verdict, never a test's
+};
+
+// Short code used in machine-readable reports.
+inline const char* verdict_code(Verdict verdict) {
+    switch (verdict) {
+        case Verdict::Accepted: return "AC";
+        case Verdict::WrongAnswer: return "WA";
+        case Verdict::TimeLimitExceeded: return "TLE";
+        case Verdict::MemoryLimitExceeded: return "MLE";
+        case Verdict::OutputLimitExceeded: return "OLE";
+        case Verdict::RuntimeError: return "RE";
+        case Verdict::JudgeError: return "JE";
+        case Verdict::CompilationError: return "CE";
+    }
+    return "??";
+}
+
+inline const char* verdict_name(Verdict verdict) {
+    switch (verdict) {
+        case Verdict::Accepted: return "Accepted";
+        case Verdict::WrongAnswer: return "Wrong Answer";
+        case Verdict::TimeLimitExceeded: return "Time Limit Exceeded";
+        case Verdict::MemoryLimitExceeded: return "Memory Limit Exceeded";
+        case Verdict::OutputLimitExceeded: return "Output Limit Exceeded";
+        case Verdict::RuntimeError: return "Runtime Error";
+        case Verdict::JudgeError: return "Judge Error";
+        case Verdict::CompilationError: return "Compilation Error";
+    }
+    return "Unknown";
+}
+
+// Verdict implied by how the process ended, before looking at its output.
+// Returns Accepted if the run itself was fine and the output must decide.
+inline Verdict classify_run(const RunResult& run, const ResourceLimits& limits) {
+    if (!run.started) return Verdict::JudgeError;
+    if (run.outputLimitExceeded) return Verdict::OutputLimitExceeded;
+    if (run.wallTimeExceeded || run.termSignal == SIGXCPU ||
+        (limits.cpuTimeMs > 0 && run.cpuTimeMs > limits.cpuTimeMs)) {
+        return Verdict::TimeLimitExceeded;
+    }
+    // RLIMIT_AS makes allocations fail rather than the RSS grow past the
+    // limit, which surfaces as an uncaught std::bad_alloc.
+    if (limits.memoryBytes > 0 &&
+        (run.peakMemoryKb * 1024LL > limits.memoryBytes ||
+         ((run.termSignal != 0 || run.exitCode != 0) && run.err.find("std::bad_alloc") != std::string::npos))) {
+        return Verdict::MemoryLimitExceeded;
+    }
+    if (run.termSignal != 0 || run.exitCode != 0) return Verdict::RuntimeError;
+    return Verdict::Accepted;
+}
+
+struct TestOutcome {
+    Verdict verdict = Verdict::JudgeError;
+    RunResult run;
+    std::string message;   // where the output differs, if the comparator knows
+
+    bool passed() const { return verdict == Verdict::Accepted; }
+};
+
+// Runs a single test. `cancel` becomes true once the result is no longer
+// needed and should be forwarded to run_process().
+using TestFunction = std::function<TestOutcome(size_t index, const std::atomic<bool>& cancel)>;
+
+// Receives outcomes strictly in index order, up to and including the first
+// failure (or all of them when not stopping on failure). Calls are
+// serialized.
+using TestReporter = std::function<void(size_t index, const TestOutcome& outcome)>;
+
+inline unsigned default_worker_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Returns the index of the lowest failing test, or `count` if all passed.
+// With stopOnFailure = false every test is run and reported (for grading).
+// `order` is the order tests are started in (a permutation of the indices,
+// empty = index order); it changes how soon a failure is found, not which
+// one is reported.
+inline size_t run_test_cases(size_t count, unsigned workers,
+                             const TestFunction& runTest, const TestReporter& report,
+                             bool stopOnFailure = true, const std::vector<size_t>& order = {}) {
+    workers = std::max(1u, std::min<unsigned>(workers, static_cast<unsigned>(std::max<size_t>(count, 1))));
+
+    std::atomic<size_t> nextPosition{0};
+    std::atomic<size_t> firstFailure{count};
+
+    // Per-worker slot: which test it is running and the flag that kills it.
+    struct Slot {
+        std::atomic<size_t> current{SIZE_MAX};
+        std::atomic<bool> cancel{false};
+    };
+    std::unique_ptr<Slot[]> slots(new Slot[workers]);
+
+    std::mutex reportMutex;
+    std::vector<std::optional<TestOutcome>> pending(count);
+    size_t nextToReport = 0;
+
+    auto recordFailure = [&](size_t index) {
+        size_t seen = firstFailure.load();
+        while (index < seen && !firstFailure.compare_exchange_weak(seen, index)) {}
+        if (index >= seen || !stopOnFailure) return;
+        for (unsigned w = 0; w < workers; ++w) {
+            size_t running = slots[w].current.load();
+            if (running != SIZE_MAX && running > index) slots[w].cancel.store(true);
+        }
+    };
+
+    auto worker = [&](Slot& slot) {
+        while (true) {
+            size_t position = nextPosition.fetch_add(1);
+            if (position >= count) break;
+            size_t index = order.empty() ? position : order[position];
+            // Publish the index before checking for failures so that a
+            // concurrent recordFailure() either sees us or we see it.
+            slot.cancel.store(false);
+            slot.current.store(index);
+            // Later positions may still hold lower indices, so skip, not stop.
+            if (stopOnFailure && index > firstFailure.load()) {
+                slot.current.store(SIZE_MAX);
+                continue;
+            }
+
+            TestOutcome outcome = runTest(index, slot.cancel);
+            // A cancel meant for this slot's previous test can arrive late;
+            // a test below the first failure is still needed, so run it again.
+            while (outcome.run.cancelled && index < firstFailure.load()) {
+                slot.cancel.store(false);
+                outcome = runTest(index, slot.cancel);
+            }
+            slot.current.store(SIZE_MAX);
+            if (outcome.run.cancelled) continue;
+            if (!outcome.passed()) recordFailure(index);
+
+            std::lock_guard<std::mutex> lock(reportMutex);
+            pending[index] = std::move(outcome);
+            while (nextToReport < count && (!stopOnFailure || nextToReport <= firstFailure.load()) &&
+                   pending[nextToReport]) {
+                report(nextToReport, *pending[nextToReport]);
+                pending[nextToReport].reset();
+                ++nextToReport;
+            }
+        }
+    };
+
+    if (workers == 1) {
+        worker(slots[0]);
+    } else {
+        std::vector<std::thread> threads;
+        threads.reserve(workers);
+        for (unsigned w = 0; w < workers; ++w) threads.emplace_back(worker, std::ref(slots[w]));
+        for (auto& t : threads) t.join();
+    }
+    return firstFailure.load();
+}
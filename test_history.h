@@ -0,0 +1,140 @@
+#pragma once
+
+// Per-problem record of how its tests behave across submissions: how often
+// each one was the test a submission failed on, and how long it runs. With
+// several workers the judge uses it to start the tests most likely to fail
+// first, so that runs of later tests are skipped or cancelled sooner, and
+// then the long tests, so they do not end up alone at the tail of the run.
+//
+// Only the execution order changes. run_test_cases() still reports the
+// lowest-numbered failing test, running the earlier tests it skipped over
+// if needed, so verdicts are the same as in file order. That also means a
+// single worker gains nothing from reordering (every test before the
+// failing one has to run either way) and keeps file order.
+//
+// Stored as one small text file per problem in the cache directory and
+// reset whenever the problem's tests change.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "compile_cache.h"
+#include "sha256.h"
+
+// Default location: next to the compile cache, e.g. ~/.cache/cpp-judge/history.
+inline std::filesystem::path default_history_dir() {
+    return default_compile_cache_dir().parent_path() / "history";
+}
+
+struct TestStats {
+    uint32_t runs = 0;         // runs that reached a verdict
+    uint32_t failures = 0;     // runs that were the submission's failing test
+    double meanMs = 0;         // wall time, recent runs weighted more
+};
+
+class TestHistory {
+public:
+    // `version` identifies the current tests (e.g. the modification time of
+    // tests/ or tests.pack); a file saved for other tests is ignored.
+    TestHistory(std::filesystem::path file, size_t count, int64_t version)
+        : file_(std::move(file)), version_(version), stats_(count) {
+        load();
+    }
+
+    // Execution order for the next submission with `workers` workers. Tests
+    // that have failed before come first, by failure rate per millisecond of
+    // running time, then the rest longest first. Empty (file order) for a
+    // single worker.
+    std::vector<size_t> order(unsigned workers) const {
+        if (workers <= 1) return {};
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<size_t> order(stats_.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        auto failRate = [&](size_t i) {
+            const TestStats& s = stats_[i];
+            return s.failures == 0 ? 0.0 : s.failures / (s.runs + 1.0) / std::max(s.meanMs, 1.0);
+        };
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            double fa = failRate(a), fb = failRate(b);
+            if (fa != fb) return fa > fb;
+            return stats_[a].meanMs > stats_[b].meanMs;
+        });
+        return order;
+    }
+
+    void record(size_t index, bool failed, long wallMs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index >= stats_.size()) return;
+        TestStats& s = stats_[index];
+        s.meanMs = s.runs == 0 ? wallMs : s.meanMs * 0.75 + wallMs * 0.25;
+        ++s.runs;
+        if (failed) ++s.failures;
+        dirty_ = true;
+    }
+
+    // Written to a temporary file and renamed, like the problem catalog.
+    // Failing to save only loses history.
+    void save() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) return;
+        std::error_code ec;
+        std::filesystem::create_directories(file_.parent_path(), ec);
+        std::filesystem::path temp = file_;
+        temp += "." + std::to_string(getpid()) + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary);
+            if (!out.is_open()) return;
+            out << header << ' ' << version_ << ' ' << stats_.size() << '\n';
+            for (const TestStats& s : stats_) out << s.runs << ' ' << s.failures << ' ' << s.meanMs << '\n';
+            if (!out) {
+                out.close();
+                std::filesystem::remove(temp, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(temp, file_, ec);
+        if (ec) std::filesystem::remove(temp, ec);
+        dirty_ = false;
+    }
+
+private:
+    static constexpr const char* header = "cpp-judge-history 1";
+
+    void load() {
+        std::ifstream in(file_);
+        std::string line;
+        if (!std::getline(in, line) || line.rfind(header, 0) != 0) return;
+        long long version = 0;
+        size_t count = 0;
+        if (std::sscanf(line.c_str() + std::char_traits<char>::length(header), " %lld %zu", &version, &count) != 2 ||
+            version != version_ || count != stats_.size()) {
+            return;
+        }
+        std::vector<TestStats> stats(count);
+        for (TestStats& s : stats) {
+            if (!(in >> s.runs >> s.failures >> s.meanMs)) return;
+        }
+        stats_ = std::move(stats);
+    }
+
+    std::filesystem::path file_;
+    int64_t version_;
+    mutable std::mutex mutex_;
+    std::vector<TestStats> stats_;
+    bool dirty_ = false;
+};
+
+// One file per problem folder: the ID for readability, plus a hash of the
+// folder's path so that two problem sets do not share history.
+inline std::filesystem::path test_history_path(const std::filesystem::path& dir, const std::filesystem::path& problemDir) {
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(problemDir, ec);
+    std::string key = sha256_hex((ec ? problemDir : absolute).string()).substr(0, 16);
+    return dir / (problemDir.filename().string() + "-" + key);
+}
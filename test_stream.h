@@ -0,0 +1,141 @@
+#pragma once
+
+// Lazy test loading for one judging run. Tests are loaded (or mapped) only
+// shortly before they run and dropped as soon as they are done, so the
+// judge's memory is bounded by a small window of tests rather than by the
+// size of the whole test set, and the first test starts without waiting
+// for the others to load.
+//
+// A background thread loads tests in execution order, keeping at most
+// `window` of them loaded but not yet released. Workers acquire() a test
+// (loading it themselves if the loader has not got to it yet) and
+// release() it once it has run.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "problems.h"
+
+// One test ready to run. `data` points into `owned` (JSON tests), into a
+// mapped pack or at raw .in/.out files.
+struct LoadedTest {
+    TestData data;
+    TestCase owned;
+    std::string error;                 // why the test could not be loaded
+    std::function<void()> onRelease;   // e.g. drops mapped pages
+
+    LoadedTest() = default;
+    LoadedTest(const LoadedTest&) = delete;
+    LoadedTest& operator=(const LoadedTest&) = delete;
+    ~LoadedTest() {
+        if (onRelease) onRelease();
+    }
+};
+
+class TestPrefetcher {
+public:
+    using Loader = std::function<std::shared_ptr<const LoadedTest>(size_t index)>;
+
+    // `order` is the order the tests will run in (empty = index order).
+    TestPrefetcher(size_t count, size_t window, Loader load, std::vector<size_t> order = {})
+        : load_(std::move(load)), slots_(count), order_(std::move(order)), window_(std::max<size_t>(window, 1)) {
+        if (count > 0) thread_ = std::thread([this] { loop(); });
+    }
+
+    TestPrefetcher(const TestPrefetcher&) = delete;
+    TestPrefetcher& operator=(const TestPrefetcher&) = delete;
+
+    ~TestPrefetcher() { stop(); }
+
+    // The test at `index`. If the loader has not started on it, the caller
+    // loads it itself rather than wait behind a full window.
+    std::shared_ptr<const LoadedTest> acquire(size_t index) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Slot& slot = slots_[index];
+        changed_.wait(lock, [&] { return slot.state != Slot::Loading; });
+        if (slot.state == Slot::Ready && slot.test) return slot.test;
+        if (slot.state == Slot::Ready) {
+            // Released already (e.g. reported after it ran); load a copy.
+            lock.unlock();
+            return load_(index);
+        }
+        slot.state = Slot::Loading;
+        lock.unlock();
+        std::shared_ptr<const LoadedTest> test = load_(index);
+        lock.lock();
+        slot.test = test;
+        slot.state = Slot::Ready;
+        ++loaded_;
+        changed_.notify_all();
+        return test;
+    }
+
+    // Drops the prefetcher's reference; the data goes once the last user
+    // of the test lets go of it.
+    void release(size_t index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot& slot = slots_[index];
+        if (slot.state != Slot::Ready || !slot.test) return;
+        slot.test.reset();
+        --loaded_;
+        changed_.notify_all();
+    }
+
+    // Stops loading ahead, e.g. once the run is decided. Tests still
+    // acquired afterwards are loaded by the caller.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    struct Slot {
+        enum State { Idle, Loading, Ready };   // Ready stays after release()
+        State state = Idle;
+        std::shared_ptr<const LoadedTest> test;
+    };
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            changed_.wait(lock, [&] {
+                while (next_ < slots_.size() && slots_[indexAt(next_)].state != Slot::Idle) ++next_;
+                return stopping_ || next_ >= slots_.size() || loaded_ < window_;
+            });
+            if (stopping_ || next_ >= slots_.size()) return;
+            const size_t index = indexAt(next_++);
+            Slot& slot = slots_[index];
+            slot.state = Slot::Loading;
+            lock.unlock();
+            std::shared_ptr<const LoadedTest> test = load_(index);
+            lock.lock();
+            slot.test = std::move(test);
+            slot.state = Slot::Ready;
+            ++loaded_;
+            changed_.notify_all();
+        }
+    }
+
+    size_t indexAt(size_t position) const { return order_.empty() ? position : order_[position]; }
+
+    Loader load_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<Slot> slots_;
+    std::vector<size_t> order_;
+    size_t window_;
+    size_t next_ = 0;             // next position in order_ the loader will look at
+    size_t loaded_ = 0;           // loaded and not yet released
+    bool stopping_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+// Per-phase tracing of a judgement: compile, problem and test loading, and
+// for every test the spawn, the run (with output capture and streaming
+// comparison), the final comparison or checker, and cleanup. A TraceSpan
+// records one phase on the current thread; the spans of all threads can be
+// written out as a Chrome trace-event file (chrome://tracing, Perfetto).
+//
+// Tracing is off by default. A disabled span costs one relaxed atomic load.
+// An enabled one reads the monotonic clock twice and appends to a ring
+// buffer owned by its thread, so old events are overwritten rather than
+// memory growing with the length of a judge server's life. Buffers of
+// threads that have exited are handed to new threads.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace trace_detail {
+
+// The strings must be literals (or otherwise live forever).
+struct Event {
+    const char* name;
+    const char* argName;      // e.g. "test", may be null
+    int64_t arg;
+    const char* detail;       // e.g. a verdict code, may be null
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t tid;
+};
+
+inline constexpr size_t eventsPerThread = 1 << 14;
+
+inline std::atomic<bool> enabled{false};
+
+inline uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Only its thread writes to a buffer; the mutex is contended only while a
+// trace is being exported.
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<Event> events = std::vector<Event>(eventsPerThread);
+    uint64_t written = 0;
+    std::atomic<bool> inUse{true};
+};
+
+class Registry {
+public:
+    ThreadBuffer* acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& buffer : buffers_) {
+            bool expected = false;
+            if (buffer->inUse.compare_exchange_strong(expected, true)) return buffer.get();
+        }
+        return buffers_.emplace_back(std::make_unique<ThreadBuffer>()).get();
+    }
+
+    template <typename F>
+    void forEach(F&& f) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& buffer : buffers_) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            f(*buffer);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;   // never freed, only reused
+};
+
+inline Registry registry;
+
+// The calling thread's buffer, taken on its first event and given back
+// when the thread exits.
+struct ThreadSlot {
+    ThreadBuffer* buffer = nullptr;
+    uint32_t tid = 0;
+
+    ~ThreadSlot() {
+        if (buffer) buffer->inUse.store(false);
+    }
+};
+
+inline thread_local ThreadSlot slot;
+
+inline void record(const Event& event) {
+    if (!slot.buffer) {
+        slot.buffer = registry.acquire();
+        slot.tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    ThreadBuffer& buffer = *slot.buffer;
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    Event& slotEvent = buffer.events[buffer.written++ % eventsPerThread];
+    slotEvent = event;
+    slotEvent.tid = slot.tid;
+}
+
+} // namespace trace_detail
+
+inline bool tracing_enabled() {
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Spans already open when tracing is switched off are still recorded.
+inline void set_tracing_enabled(bool on) {
+    trace_detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+// Records the time from construction to end() or destruction as one event,
+// optionally with one numeric argument such as the test number.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* argName = nullptr, int64_t arg = 0)
+        : event_{name, argName, arg, nullptr, tracing_enabled() ? trace_detail::now_ns() : 0, 0, 0} {}
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() { end(); }
+
+    // A short annotation shown with the event; must outlive the trace.
+    void detail(const char* text) { event_.detail = text; }
+
+    void end() {
+        if (event_.startNs == 0) return;
+        event_.durationNs = trace_detail::now_ns() - event_.startNs;
+        trace_detail::record(event_);
+        event_.startNs = 0;
+    }
+
+private:
+    trace_detail::Event event_;   // startNs 0 = not recording
+};
+
+// Drops all recorded events, e.g. before judging the next submission.
+inline void clear_trace() {
+    trace_detail::registry.forEach([](trace_detail::ThreadBuffer& buffer) { buffer.written = 0; });
+}
+
+// Writes every event still in the ring buffers as a Chrome trace-event
+// JSON document, oldest first, with timestamps relative to the first one.
+inline void write_chrome_trace(std::ostream& out) {
+    std::vector<trace_detail::Event> events;
+    trace_detail::registry.forEach([&](trace_detail::ThreadBuffer& buffer) {
+        uint64_t kept = std::min<uint64_t>(buffer.written, trace_detail::eventsPerThread);
+        for (uint64_t i = buffer.written - kept; i < buffer.written; ++i) {
+            events.push_back(buffer.events[i % trace_detail::eventsPerThread]);
+        }
+    });
+    std::sort(events.begin(), events.end(),
+              [](const trace_detail::Event& a, const trace_detail::Event& b) { return a.startNs < b.startNs; });
+    const uint64_t base = events.empty() ? 0 : events.front().startNs;
+    const long pid = static_cast<long>(getpid());
+    char number[64];
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const trace_detail::Event& e = events[i];
+        // Names and details are identifiers from the judge's own code and
+        // need no escaping.
+        out << (i ? ",\n" : "\n") << "{\"name\": \"" << e.name << "\", \"cat\": \"judge\", \"ph\": \"X\", \"pid\": "
+            << pid << ", \"tid\": " << e.tid;
+        std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(e.startNs - base) / 1000);
+        out << ", \"ts\": " << number;
+        std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(e.durationNs) / 1000);
+        out << ", \"dur\": " << number << ", \"args\": {";
+        if (e.argName) out << "\"" << e.argName << "\": " << e.arg;
+        if (e.detail) out << (e.argName ? ", " : "") << "\"detail\": \"" << e.detail << "\"";
+        out << "}}";
+    }
+    out << "\n]}\n";
+}
+
+inline bool write_chrome_trace(const std::string& path, std::string& error) {
+    std::ofstream out(path, std::ios::trunc);
+    write_chrome_trace(out);
+    if (!out) error = "cannot write " + path;
+    return static_cast<bool>(out);
+}